@@ -0,0 +1,110 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Describes how the poses and joint positions of one arm map to the other arm of a mirror-symmetric robot
+
+#ifndef BLOCK_GRASP_GENERATOR__ARM_SYMMETRY_
+#define BLOCK_GRASP_GENERATOR__ARM_SYMMETRY_
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// C++
+#include <vector>
+#include <cstddef>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief A mirror-symmetric pair of arms, e.g. Baxter's left and right arm. A pose of one arm's end effector maps
+ *        to the other arm by reflecting the base frame across the plane of symmetry and the end effector frame
+ *        so that the result is a rotation again. Joint positions map joint by joint with a sign and an offset.
+ *        The defaults reflect across the base frame's xz plane
+ */
+struct ArmSymmetry
+{
+  ArmSymmetry() :
+    base_reflection_(Eigen::Affine3d::Identity()),
+    eef_reflection_(Eigen::Matrix3d::Identity()),
+    max_seed_distance_(0.02),
+    verify_timeout_(0.005),
+    solve_unverified_(true)
+  {
+    base_reflection_.linear() = Eigen::Vector3d(1, -1, 1).asDiagonal();
+    eef_reflection_ = Eigen::Vector3d(1, -1, 1).asDiagonal();
+  }
+  Eigen::Affine3d base_reflection_; // reflects the base frame across the plane of symmetry, its own inverse
+  Eigen::Matrix3d eef_reflection_; // reflects the end effector frame, its own inverse
+  std::vector<double> joint_signs_; // per joint of the planning group, -1 where the other arm turns the other way
+  std::vector<double> joint_offsets_; // per joint, added after the sign. Empty for none
+
+  // See GraspFilter::filterMirroredGrasps()
+  double max_seed_distance_; // a mirrored solution further than this (seed database distance) is no seed
+  double verify_timeout_; // seconds for checking a mirrored solution on the other arm
+  bool solve_unverified_; // give the candidates without a mirrored solution, or whose solution did not verify, a
+                          // full IK query. Otherwise the other arm only gets the grasps mirrored from the first
+
+  /**
+   * \brief The other arm's end effector pose, in the same base frame
+   */
+  Eigen::Affine3d mirrorPose(const Eigen::Affine3d& pose) const
+  {
+    Eigen::Affine3d eef_reflection(Eigen::Affine3d::Identity());
+    eef_reflection.linear() = eef_reflection_;
+    return base_reflection_ * pose * eef_reflection;
+  }
+
+  /**
+   * \brief The other arm's joint positions
+   * \param mirrored - num_joints values, may be joints
+   */
+  void mirrorJoints(const double* joints, std::size_t num_joints, double* mirrored) const
+  {
+    for (std::size_t i = 0; i < num_joints; ++i)
+    {
+      double sign = i < joint_signs_.size() ? joint_signs_[i] : 1.0;
+      double offset = i < joint_offsets_.size() ? joint_offsets_[i] : 0.0;
+      mirrored[i] = sign * joints[i] + offset;
+    }
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+} // namespace
+
+#endif
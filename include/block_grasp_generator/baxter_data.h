@@ -38,6 +38,7 @@
 
 // Blocks
 #include <block_grasp_generator/block_grasp_generator.h> // has datastructure
+#include <block_grasp_generator/arm_symmetry.h>
 
 namespace baxter_pick_place
 {
@@ -119,6 +120,17 @@ block_grasp_generator::RobotGraspData loadRobotGraspData(const std::string& arm,
   return grasp_data;
 }
 
+// The left arm is the mirror image of the right arm across the base frame's xz plane, which are the default
+// reflections. Of the joints s0 s1 e0 e1 w0 w1 w2, s0 e0 w0 and w2 turn the other way
+inline block_grasp_generator::ArmSymmetry loadArmSymmetry()
+{
+  static const double JOINT_SIGNS[] = {-1, 1, -1, 1, -1, 1, -1};
+
+  block_grasp_generator::ArmSymmetry symmetry;
+  symmetry.joint_signs_.assign(JOINT_SIGNS, JOINT_SIGNS + 7);
+  return symmetry;
+}
+
 
 
 } // namespace
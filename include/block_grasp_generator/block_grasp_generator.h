@@ -52,7 +52,18 @@
 // Rviz
 #include <moveit_visual_tools/visual_tools.h>
 
+// Grasp geometry
+#include <block_grasp_generator/grasp_generator_core.h>
+#include <block_grasp_generator/grasp_arena.h>
+#include <block_grasp_generator/grasp_executor.h>
+#include <block_grasp_generator/grasp_statistics.h>
+#include <block_grasp_generator/grasp_trace.h>
+#include <block_grasp_generator/grasp_log.h>
+#include <block_grasp_generator/grasp_slot_history.h>
+
 // C++
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
 #include <math.h>
 #define _USE_MATH_DEFINES
 
@@ -68,6 +79,14 @@ struct RobotGraspData
     base_link_("/base_link"), 
     grasp_depth_(0.12), 
     angle_resolution_(16),
+    max_angle_resolution_(0),
+    refine_quality_threshold_(0),
+    block_symmetry_order_(4),
+    gripper_symmetry_order_(2),
+    symmetry_position_tolerance_(0.01),
+    symmetry_angle_tolerance_(0),
+    face_arm_base_(false),
+    min_arm_base_alignment_(-1),
     approach_retreat_desired_dist_(0.6),
     approach_retreat_min_dist_(0.4),
     block_size_(0.04)
@@ -81,6 +100,15 @@ struct RobotGraspData
   std::string ee_joint_; // the joint to actuate for gripping
   double grasp_depth_; // distance from center point of object to end effector
   int angle_resolution_; // generate grasps at PI/angle_resolution increments
+  int max_angle_resolution_; // adaptive sampling refines feasible angles up to PI/max_angle_resolution (<= angle_resolution_ to disable)
+  double refine_quality_threshold_; // adaptive sampling also refines infeasible angles scoring at least this (<=0 to disable)
+  int block_symmetry_order_; // the block looks the same after rotating 2*PI/order around its z axis
+  int gripper_symmetry_order_; // the gripper grasps the same after rotating 2*PI/order around its approach axis
+  double symmetry_position_tolerance_; // grasps closer than this (meters) after applying symmetries are equivalent
+  double symmetry_angle_tolerance_; // grasps closer than this (radians) after applying symmetries are equivalent (<=0 to disable)
+  bool face_arm_base_; // order grasps so the wrist faces back toward the arm base first
+  geometry_msgs::Point arm_base_position_; // in base_link_, e.g. from GraspFilter::getArmBasePosition()
+  double min_arm_base_alignment_; // when facing the arm base, drop grasps less aligned than this, in [-1, 1]
   double approach_retreat_desired_dist_; // how far back from the grasp position the pregrasp phase should be
   double approach_retreat_min_dist_; // how far back from the grasp position the pregrasp phase should be at minimum
   double block_size_; // for visualization
@@ -92,19 +120,31 @@ class BlockGraspGenerator
 {
 private:
 
-  // Grasp axis orientation
-  enum grasp_axis_t {X_AXIS, Y_AXIS, Z_AXIS};
-  enum grasp_direction_t {UP, DOWN};
+  // ROS-independent grasp sweep
+  GraspGeneratorCore generator_core_;
 
   // class for publishing stuff to rviz
   moveit_visual_tools::VisualToolsPtr visual_tools_;
 
-  // Transform from frame of box to global frame
-  Eigen::Affine3d block_global_transform_; 
-
   // Choose whether the end effector is animated and shown for each potential grasp
   bool animate_;
 
+  // Request id used for the grasp ids when the caller does not provide one
+  boost::atomic<uint32_t> next_request_id_;
+
+  // Candidates of the last request dropped as symmetric to a kept one
+  GraspCandidates symmetric_variants_;
+  mutable boost::mutex symmetric_variants_mutex_;
+
+  // Runs the asynchronous requests, created on first use
+  GraspExecutorPtr executor_;
+
+  // Latency of every stage
+  GraspStatisticsPtr statistics_;
+
+  // Which slots of the sweeps were feasible in earlier requests, NULL to keep every slot
+  GraspSlotHistoryPtr slot_history_;
+
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW // Eigen requires 128-bit alignment for the Eigen::Vector2d's array (of 2 doubles). With GCC, this is done with a attribute ((aligned(16))).
 
@@ -127,6 +167,120 @@ public:
   bool generateGrasps(const geometry_msgs::Pose& block_pose, const RobotGraspData& grasp_data,
                       std::vector<moveit_msgs::Grasp>& possible_grasps);
 
+  /**
+   * \brief Create all possible grasp positions for a block without converting them to messages.
+   *        Filter these first and then only convert the survivors with convertGrasps()
+   * \param block_pose
+   * \param grasp_data - custom settings for a robot's geometry
+   * \param possible_grasps - result is appended to this
+   */
+  bool generateGrasps(const geometry_msgs::Pose& block_pose, const RobotGraspData& grasp_data,
+                      GraspCandidates& possible_grasps);
+
+  /**
+   * \brief Same as above, with the request id the grasp ids are derived from. Use this when ids need to
+   *        match a previous run. Several threads may generate at once as long as the visual tools are muted,
+   *        getSymmetricVariants() then returns the variants of whichever request finished last
+   */
+  bool generateGrasps(const geometry_msgs::Pose& block_pose, const RobotGraspData& grasp_data,
+                      GraspCandidates& possible_grasps, uint32_t request_id);
+
+  /**
+   * \brief Recover the candidates of the last request that were dropped because they are symmetric
+   *        to a kept one, see RobotGraspData::symmetry_angle_tolerance_
+   * \param canonical - id of the kept candidate
+   * \param variants - result is appended to this
+   */
+  void getSymmetricVariants(const GraspId& canonical, GraspCandidates& variants) const
+  {
+    boost::mutex::scoped_lock slock(symmetric_variants_mutex_);
+    GraspGeneratorCore::getSymmetricVariants(canonical, symmetric_variants_, variants);
+  }
+
+  /**
+   * \brief Non-blocking generateGrasps(), runs on getExecutor(). Do not call the blocking functions of this
+   *        generator until the future is ready
+   * \param block_pose - copied
+   * \param grasp_data - copied
+   * \param arena - reset and filled with the candidates, a new one if NULL. Reuse arenas to avoid allocating
+   * \return future of the arena, ready to be chained into GraspFilter::filterGraspsAsync()
+   */
+  boost::shared_future<GraspArenaPtr> generateGraspsAsync(const geometry_msgs::Pose& block_pose,
+                                                          const RobotGraspData& grasp_data,
+                                                          GraspArenaPtr arena = GraspArenaPtr());
+
+  /**
+   * \brief The thread asynchronous requests run on. Share it with a GraspFilter so that generation and
+   *        filtering are chained without waiting
+   */
+  GraspExecutorPtr getExecutor();
+
+  void setExecutor(GraspExecutorPtr executor)
+  {
+    executor_ = executor;
+  }
+
+  /**
+   * \brief Where the latencies of generation, pre-filtering, conversion and visualization are recorded. Share it
+   *        with a GraspFilter to see a whole request's stages in one place
+   */
+  GraspStatisticsPtr getStatistics() const
+  {
+    return statistics_;
+  }
+
+  void setStatistics(GraspStatisticsPtr statistics)
+  {
+    statistics_ = statistics;
+  }
+
+  /**
+   * \brief Skip, or try last, the slots of the sweeps that have almost never been feasible for blocks at the
+   *        same place. The generator only reads it: share it with the GraspFilter of the same arm and filter with
+   *        an overload that takes the block pose, e.g. GraspFilter::filterGrasps(block_pose, arena), or nothing is
+   *        ever learned and nothing pruned. See GraspSlotHistory
+   * \param slot_history - NULL to keep every slot
+   */
+  void setSlotHistory(GraspSlotHistoryPtr slot_history)
+  {
+    slot_history_ = slot_history;
+  }
+
+  GraspSlotHistoryPtr getSlotHistory() const
+  {
+    return slot_history_;
+  }
+
+private:
+
+  // Body of generateGraspsAsync()
+  GraspArenaPtr generateGraspsTask(geometry_msgs::Pose block_pose, RobotGraspData grasp_data, GraspArenaPtr arena);
+
+public:
+
+  /**
+   * \brief Convert core grasp candidates to full manipulation messages
+   * \param candidates
+   * \param grasp_data - custom settings for a robot's geometry
+   * \param possible_grasps - result is appended to this
+   */
+  static void convertGrasps(const GraspCandidates& candidates, const RobotGraspData& grasp_data,
+                            std::vector<moveit_msgs::Grasp>& possible_grasps);
+
+  /**
+   * \brief Extract the settings the ROS-independent core needs from a robot's grasp data
+   */
+  static void getGraspGeometry(const RobotGraspData& grasp_data, GraspGeometry& geometry);
+
+  /**
+   * \brief Convert a core grasp candidate to a full manipulation message
+   * \param candidate - generated by the core
+   * \param grasp_data - custom settings for a robot's geometry
+   * \param new_grasp - result
+   */
+  static void convertGrasp(const GraspCandidate& candidate, const RobotGraspData& grasp_data,
+                           moveit_msgs::Grasp& new_grasp);
+
   /**
    * \brief Show all grasps in Rviz
    * \param possible_grasps
@@ -149,6 +303,9 @@ public:
     ROS_INFO_STREAM_NAMED("grasp","EE Parent Link: " << data.ee_parent_link_);
     ROS_INFO_STREAM_NAMED("grasp","Grasp Depth: " << data.grasp_depth_);
     ROS_INFO_STREAM_NAMED("grasp","Angle Resolution: " << data.angle_resolution_);
+    ROS_INFO_STREAM_NAMED("grasp","Max Angle Resolution: " << data.max_angle_resolution_);
+    ROS_INFO_STREAM_NAMED("grasp","Symmetry Angle Tolerance: " << data.symmetry_angle_tolerance_);
+    ROS_INFO_STREAM_NAMED("grasp","Face Arm Base: " << data.face_arm_base_);
     ROS_INFO_STREAM_NAMED("grasp","Approach Retreat Desired Dist: " << data.approach_retreat_desired_dist_);
     ROS_INFO_STREAM_NAMED("grasp","Approach Retreat Min Dist: " << data.approach_retreat_min_dist_);
     ROS_INFO_STREAM_NAMED("grasp","Pregrasp Posture: \n" << data.pre_grasp_posture_);
@@ -156,12 +313,6 @@ public:
     ROS_INFO_STREAM_NAMED("grasp","---------------------------------------------------\n");
   }
 
-private:
-
-  // Create grasp positions in one axis
-  bool generateAxisGrasps(std::vector<moveit_msgs::Grasp>& possible_grasps, grasp_axis_t axis,
-                          grasp_direction_t direction, const RobotGraspData& grasp_data);
-                          
 }; // end of class
 
 typedef boost::shared_ptr<BlockGraspGenerator> BlockGraspGeneratorPtr;
@@ -0,0 +1,168 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Fixed capacity queue for handing work between threads
+
+#ifndef BLOCK_GRASP_GENERATOR__BOUNDED_QUEUE_
+#define BLOCK_GRASP_GENERATOR__BOUNDED_QUEUE_
+
+// C++
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief A first in, first out queue that blocks producers while it is full and consumers while it is empty.
+ *        Once closed, pushing fails and popping drains what is left. Storage is only allocated by reset()
+ */
+template <typename T>
+class BoundedQueue
+{
+private:
+  std::vector<T> buffer_; // ring buffer, only the first capacity_ items are used
+  std::size_t capacity_;
+  std::size_t head_; // next to pop
+  std::size_t size_;
+  bool closed_;
+
+  boost::mutex mutex_;
+  boost::condition_variable not_empty_cond_;
+  boost::condition_variable not_full_cond_;
+
+public:
+
+  // Constructor
+  explicit BoundedQueue(std::size_t capacity = 1)
+    : buffer_(capacity > 0 ? capacity : 1),
+      capacity_(buffer_.size()),
+      head_(0),
+      size_(0),
+      closed_(false)
+  {
+  }
+
+  /**
+   * \brief Empty and reopen the queue with a new capacity. Only allocates when growing beyond every previous
+   *        capacity. Not safe while other threads use the queue
+   */
+  void reset(std::size_t capacity)
+  {
+    capacity_ = capacity > 0 ? capacity : 1;
+    if( buffer_.size() < capacity_ )
+      buffer_.resize(capacity_);
+    head_ = 0;
+    size_ = 0;
+    closed_ = false;
+  }
+
+  /**
+   * \brief Add an item, waiting for room
+   * \return false if the queue was closed
+   */
+  bool push(const T& item)
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    while( size_ == capacity_ && !closed_ )
+      not_full_cond_.wait(slock);
+    if( closed_ )
+      return false;
+
+    buffer_[(head_ + size_) % capacity_] = item;
+    ++size_;
+    not_empty_cond_.notify_one();
+    return true;
+  }
+
+  /**
+   * \brief Take the oldest item, waiting for one
+   * \return false if the queue is closed and empty
+   */
+  bool pop(T& item)
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    while( size_ == 0 && !closed_ )
+      not_empty_cond_.wait(slock);
+    return popLocked(item);
+  }
+
+  /**
+   * \brief Take the oldest item if there is one
+   * \return false if the queue is empty
+   */
+  bool tryPop(T& item)
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    return popLocked(item);
+  }
+
+  std::size_t getCapacity() const
+  {
+    return capacity_;
+  }
+
+  /**
+   * \brief Wake up everyone waiting. Pushing fails from now on, popping returns the remaining items
+   */
+  void close()
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    closed_ = true;
+    not_empty_cond_.notify_all();
+    not_full_cond_.notify_all();
+  }
+
+private:
+
+  bool popLocked(T& item)
+  {
+    if( size_ == 0 )
+      return false;
+
+    item = buffer_[head_];
+    head_ = (head_ + 1) % capacity_;
+    --size_;
+    not_full_cond_.notify_one();
+    return true;
+  }
+
+}; // end of class
+
+} // namespace
+
+#endif
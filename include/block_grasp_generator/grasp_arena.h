@@ -0,0 +1,166 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Request-scoped storage for grasp candidates and their IK solutions. Reset between requests
+//         so that after warm-up generating and filtering grasps does not touch the heap
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_ARENA_
+#define BLOCK_GRASP_GENERATOR__GRASP_ARENA_
+
+// Grasp geometry
+#include <block_grasp_generator/grasp_generator_core.h>
+
+// C++
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace block_grasp_generator
+{
+
+// Class
+class GraspArena
+{
+private:
+
+  // Candidates of the current request
+  GraspCandidates candidates_;
+
+  // IK solution of every candidate, num_joints_ values each
+  std::vector<double> solutions_;
+  std::size_t num_joints_;
+
+  // Which IK tier found the solution of every candidate, -1 if none. Every IK thread only writes the slots
+  // of its own candidates, so results are collected without locking
+  std::vector<int> ik_tiers_;
+
+  // Indices of the feasible candidates
+  std::vector<std::size_t> filtered_ids_;
+
+  // Working memory of the prefilters and of adaptive sampling
+  GraspScratch scratch_;
+
+public:
+
+  // Constructor
+  GraspArena();
+
+  // Destructor
+  ~GraspArena();
+
+  /**
+   * \brief Forget the previous request but keep all allocated memory
+   */
+  void reset();
+
+  /**
+   * \brief Allocate enough memory for a request, only allocates when growing
+   * \param num_candidates - see GraspGeneratorCore::getNumGrasps()
+   * \param num_joints - variable count of the planning group
+   */
+  void reserve(std::size_t num_candidates, std::size_t num_joints);
+
+  GraspCandidates& getCandidates()
+  {
+    return candidates_;
+  }
+
+  const GraspCandidates& getCandidates() const
+  {
+    return candidates_;
+  }
+
+  std::vector<std::size_t>& getFilteredIds()
+  {
+    return filtered_ids_;
+  }
+
+  /**
+   * \brief Working memory for GraspGeneratorCore, kept across reset()
+   */
+  GraspScratch& getScratch()
+  {
+    return scratch_;
+  }
+
+  std::size_t getNumJoints() const
+  {
+    return num_joints_;
+  }
+
+  /**
+   * \brief IK solution slot of a candidate, valid until the next reserve()
+   */
+  double* getSolution(std::size_t candidate_id)
+  {
+    return &solutions_[candidate_id * num_joints_];
+  }
+
+  const double* getSolution(std::size_t candidate_id) const
+  {
+    return &solutions_[candidate_id * num_joints_];
+  }
+
+  /**
+   * \brief Mark the candidates in [first_id, end_id) as not solved
+   */
+  void clearIkTiers(std::size_t first_id, std::size_t end_id);
+
+  /**
+   * \brief Index of the IK tier that found a candidate's solution, see GraspFilter::setIkTiers(). -1 if none
+   */
+  int getIkTier(std::size_t candidate_id) const
+  {
+    return ik_tiers_[candidate_id];
+  }
+
+  void setIkTier(std::size_t candidate_id, int ik_tier)
+  {
+    ik_tiers_[candidate_id] = ik_tier;
+  }
+
+  /**
+   * \brief Keep only the candidates in getFilteredIds(), together with their solutions.
+   *        getFilteredIds() must be sorted
+   */
+  void compact();
+
+}; // end of class
+
+typedef boost::shared_ptr<GraspArena> GraspArenaPtr;
+
+} // namespace
+
+#endif
@@ -0,0 +1,128 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Runs grasp generation and filtering requests in the background and hands out futures of their results
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_EXECUTOR_
+#define BLOCK_GRASP_GENERATOR__GRASP_EXECUTOR_
+
+// C++
+#include <boost/thread.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <deque>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief A single background thread that runs tasks in the order they were submitted. Generators and filters are
+ *        not safe to call from several threads at once, so one thread is enough and it makes chaining simple: a
+ *        continuation submitted after its antecedent on the same executor always finds the antecedent done.
+ *        The parallelism of a request lives inside GraspFilter's IK threads
+ */
+class GraspExecutor
+{
+private:
+  std::deque<boost::function<void()> > tasks_;
+  boost::mutex mutex_;
+  boost::condition_variable tasks_cond_;
+  bool shutdown_;
+  boost::thread thread_;
+
+public:
+
+  // Constructor, starts the thread
+  GraspExecutor();
+
+  // Destructor, finishes the queued tasks then stops the thread
+  ~GraspExecutor();
+
+  /**
+   * \brief Queue a task
+   * \return future of the task's result, or of the exception it threw
+   */
+  template <typename R>
+  boost::shared_future<R> submit(const boost::function<R()>& task)
+  {
+    boost::shared_ptr<boost::packaged_task<R> > packaged_task(new boost::packaged_task<R>(task));
+    boost::shared_future<R> future(packaged_task->get_future());
+    post(boost::bind(&GraspExecutor::runTask<R>, packaged_task));
+    return future;
+  }
+
+  /**
+   * \brief Queue a task that receives the result of another one, without blocking the caller. If the
+   *        antecedent was not submitted to this executor the executor waits for it
+   * \return future of the continuation's result. An exception of the antecedent is passed on
+   */
+  template <typename R, typename A>
+  boost::shared_future<R> then(const boost::shared_future<A>& antecedent,
+                               const boost::function<R(const A&)>& continuation)
+  {
+    return submit<R>(boost::bind(&GraspExecutor::runContinuation<R, A>, antecedent, continuation));
+  }
+
+  /**
+   * \brief Queue a task without a result
+   */
+  void post(const boost::function<void()>& task);
+
+private:
+
+  // Main loop of the thread
+  void run();
+
+  template <typename R>
+  static void runTask(boost::shared_ptr<boost::packaged_task<R> > packaged_task)
+  {
+    (*packaged_task)();
+  }
+
+  template <typename R, typename A>
+  static R runContinuation(boost::shared_future<A> antecedent, boost::function<R(const A&)> continuation)
+  {
+    return continuation(antecedent.get());
+  }
+
+}; // end of class
+
+typedef boost::shared_ptr<GraspExecutor> GraspExecutorPtr;
+
+} // namespace
+
+#endif
@@ -47,6 +47,7 @@
 #include <moveit_msgs/Grasp.h>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
+#include <eigen_conversions/eigen_msg.h>
 
 // Rviz
 #include <visualization_msgs/Marker.h>
@@ -57,44 +58,213 @@
 #include <moveit/planning_scene_monitor/planning_scene_monitor.h>
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/kinematics_plugin_loader/kinematics_plugin_loader.h>
+#include <pluginlib/class_loader.h>
+
+// Grasp geometry
+#include <block_grasp_generator/grasp_generator_core.h>
+#include <block_grasp_generator/grasp_arena.h>
+#include <block_grasp_generator/ik_seed_database.h>
+#include <block_grasp_generator/ik_timeout_model.h>
+#include <block_grasp_generator/grasp_slot_history.h>
+#include <block_grasp_generator/arm_symmetry.h>
+#include <block_grasp_generator/bounded_queue.h>
+#include <block_grasp_generator/grasp_executor.h>
+#include <block_grasp_generator/grasp_statistics.h>
+#include <block_grasp_generator/grasp_trace.h>
+#include <block_grasp_generator/grasp_log.h>
 
 // C++
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <boost/function.hpp>
+#include <random_numbers/random_numbers.h>
+#include <map>
 #include <math.h>
 #define _USE_MATH_DEFINES
 
 namespace block_grasp_generator
 {
 
+// Where an IK query starts from
+enum ik_seed_t
+{
+  SEED_NEAREST,      // the closest pose in the seed database, else the previous solution
+  SEED_PREVIOUS,     // the previous solution of the same thread
+  SEED_RANDOM,       // random joint values
+  SEED_CURRENT_STATE // the robot's current joint values
+};
+
+/**
+ * \brief Racing several seeds per pose: a pose is solved concurrently from different seeds and the first solution
+ *        wins. The seeds share the request's threads, so fewer poses are solved at once. Trades CPU for fewer
+ *        queries running to the full timeout
+ */
+struct IkHedgeSettings
+{
+  IkHedgeSettings() :
+    num_seeds_(1),
+    cpu_budget_(0)
+  {}
+  int num_seeds_; // solvers per pose, one per seed type in the order of ik_seed_t, then random. 1 disables,
+                  // streamGrasps() always uses one solver per pose with SEED_NEAREST
+  double cpu_budget_; // solver seconds a request may spend, the other seeds only start queries whose timeout still
+                      // fits, SEED_NEAREST always continues (<=0 for unlimited)
+};
+
+/**
+ * \brief One solver of the chain GraspFilter tries in order, e.g. a fast analytic solver with a short timeout
+ *        first and the numerical one configured in kinematics.yaml as the fallback
+ */
+struct IkTier
+{
+  IkTier(const std::string& plugin_name = "", double timeout = 0) :
+    plugin_name_(plugin_name),
+    timeout_(timeout)
+  {}
+  std::string plugin_name_; // kinematics plugin class, e.g. an IKFast solver. Empty for the group's kinematics.yaml solver
+  double timeout_; // seconds per query, <=0 for the filter's default timeout
+};
+
+/**
+ * \brief When a block that is detected again every frame counts as the same block, see
+ *        GraspFilter::updateTrackedGrasps()
+ */
+struct TrackingSettings
+{
+  TrackingSettings() :
+    position_tolerance_(0.05),
+    angle_tolerance_(0.35),
+    max_new_candidates_(16)
+  {}
+  double position_tolerance_; // meters the block may move between updates and still be tracked
+  double angle_tolerance_; // radians the block may turn between updates and still be tracked
+  std::size_t max_new_candidates_; // candidates that were not feasible yet, checked again per update
+};
+
+// Grasps of a tracked block, kept between updates
+struct TrackedObject
+{
+  Eigen::Affine3d block_pose_; // at the last update
+  GraspCandidates candidates_; // poses in the block's frame, so they move with it
+  std::vector<char> feasible_; // per candidate, as of the last time it was checked
+  std::vector<double> solutions_; // per candidate, the last IK solution found
+  std::size_t next_candidate_; // where the next update continues checking candidates that were not feasible
+  std::vector<std::size_t> scheduled_; // candidate of every arena entry in the current update
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+typedef boost::shared_ptr<TrackedObject> TrackedObjectPtr;
+
+/**
+ * \brief How GraspFilter picks the number of IK threads for a request, from the number of grasps, the measured
+ *        cost of recent IK queries and the load of the computer. The solvers of max_threads_ threads are
+ *        loaded once and only as many as needed are woken up
+ */
+struct ConcurrencySettings
+{
+  ConcurrencySettings() :
+    max_threads_(0),
+    min_work_per_thread_(0.002),
+    latency_smoothing_(0.3),
+    use_load_average_(true)
+  {}
+  int max_threads_; // size of the solver pool, <=0 for one per core
+  double min_work_per_thread_; // seconds of expected IK time that justify waking up another thread
+  double latency_smoothing_; // weight of the latest request in the running IK latency estimate, in (0, 1]
+  bool use_load_average_; // leave cores that are busy with other processes alone
+};
+
+/**
+ * \brief Where and how the IK threads run, e.g. to keep them off the cores reserved for real-time control
+ */
+struct WorkerSchedulingSettings
+{
+  WorkerSchedulingSettings() :
+    pin_workers_(false),
+    policy_(SCHED_OTHER),
+    priority_(0)
+  {}
+  std::vector<int> cpu_set_; // cores the IK threads may run on, empty for all
+  bool pin_workers_; // pin every thread to a single core of cpu_set_, round robin
+  int policy_; // SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR
+  int priority_; // for SCHED_FIFO and SCHED_RR
+};
+
 // Struct for passing parameters to threads, for cleaner code
 struct IkThreadStruct
 {
-  IkThreadStruct(std::vector<moveit_msgs::Grasp> &possible_grasps, // the input
-                 std::vector<moveit_msgs::Grasp> &filtered_grasps, // the result
+  IkThreadStruct()
+    : arena_(NULL),
+      grasps_id_start_(0),
+      grasps_id_end_(0),
+      timeout_(0),
+      lock_(NULL),
+      thread_id_(0),
+      seed_type_(SEED_NEAREST),
+      candidate_queue_(NULL),
+      result_queue_(NULL)
+  {
+  }
+  IkThreadStruct(GraspArena *arena, // the input and the result
                  int grasps_id_start,
                  int grasps_id_end,
-                 kinematics::KinematicsBasePtr kin_solver,
                  double timeout,
                  boost::mutex *lock,
-                 int thread_id)
-    : possible_grasps_(possible_grasps),
-      filtered_grasps_(filtered_grasps),
+                 int thread_id,
+                 ik_seed_t seed_type)
+    : arena_(arena),
       grasps_id_start_(grasps_id_start),
       grasps_id_end_(grasps_id_end),
-      kin_solver_(kin_solver),
       timeout_(timeout),
       lock_(lock),
-      thread_id_(thread_id)
+      thread_id_(thread_id),
+      seed_type_(seed_type),
+      candidate_queue_(NULL),
+      result_queue_(NULL)
   {
   }
-  std::vector<moveit_msgs::Grasp> &possible_grasps_;
-  std::vector<moveit_msgs::Grasp> &filtered_grasps_;
+  GraspArena *arena_;
   int grasps_id_start_;
   int grasps_id_end_;
-  kinematics::KinematicsBasePtr kin_solver_;
   double timeout_;
   boost::mutex *lock_;
   int thread_id_;
+  ik_seed_t seed_type_;
+  BoundedQueue<std::size_t> *candidate_queue_; // when streaming, the grasps to check instead of the id range
+  BoundedQueue<std::size_t> *result_queue_; // when streaming, receives the feasible grasps
+};
+
+/**
+ * \brief Receives each feasible grasp as soon as it is found, see GraspFilter::streamGrasps()
+ * \param candidate - the feasible grasp
+ * \param solution - its IK solution, GraspArena::getNumJoints() values
+ */
+typedef boost::function<void(const GraspCandidate& candidate, const double* solution)> FeasibleGraspCallback;
+
+// Persistent state of one IK thread, reused between requests so that filtering does not allocate
+struct IkWorker
+{
+  IkWorker()
+    : ik_time_(0),
+      ik_calls_(0),
+      ik_counts_(NUM_GRASP_COUNTERS, 0)
+  {
+  }
+
+  std::vector<kinematics::KinematicsBasePtr> kin_solvers_; // one per IK tier
+  std::vector<double> ik_seed_state_;
+  std::vector<double> solution_;
+  moveit_msgs::MoveItErrorCodes error_code_;
+  IkThreadStruct job_; // the current request's share of work
+  boost::shared_ptr<random_numbers::RandomNumberGenerator> rng_; // for SEED_RANDOM
+  boost::shared_ptr<boost::thread> thread_;
+  boost::shared_ptr<boost::condition_variable> start_cond_; // wakes up only this worker
+  double ik_time_; // seconds spent in IK during the current request
+  int ik_calls_; // IK queries during the current request
+  LatencyHistogram ik_call_histogram_; // of the current request, merged into the statistics when it finishes
+  std::vector<boost::uint64_t> ik_counts_; // per grasp_counter_t, same
 };
 
 
@@ -109,21 +279,108 @@ private:
   const std::string base_link_;
   const std::string planning_group_;
 
-  // threaded kinematic solvers
-  std::vector<kinematics::KinematicsBasePtr> kin_solvers_;
+  // threaded kinematic solvers, their threads live as long as the filter
+  std::vector<IkWorker> ik_workers_;
+  boost::mutex workers_mutex_;
+  boost::condition_variable workers_done_cond_;
+  unsigned long workers_job_count_; // incremented for every request
+  std::size_t workers_active_; // workers taking part in the current request, the first ones of the pool
+  int workers_running_; // workers that have not finished the current request
+  bool workers_shutdown_;
+  boost::atomic<bool> cancelled_; // see cancelRequests()
+
+  // picking the number of threads per request
+  ConcurrencySettings concurrency_settings_;
+  bool pool_changed_; // the pool needs to be reloaded
+  double ik_latency_estimate_; // seconds per IK query, smoothed over recent requests, <=0 if unknown
+
+  // where the IK threads run
+  WorkerSchedulingSettings scheduling_settings_;
+
+  // creates the group's solvers, from the kinematics plugin loader unless set
+  robot_model::SolverAllocatorFn solver_allocator_;
+
+  // solutions of previously solved poses, for seeding IK
+  IkSeedDatabasePtr seed_database_;
+
+  // solve times of previous queries, for choosing the timeout of each query
+  IkTimeoutModelPtr timeout_model_;
+  double ik_timeout_; // seconds, used when the timeout model knows nothing about a pose
+
+  // feasibility of the slots of the sweeps in earlier requests, NULL to not keep it
+  GraspSlotHistoryPtr slot_history_;
+  std::vector<char> pruned_slots_;
+
+  // chain of solvers tried in order
+  std::vector<IkTier> ik_tiers_;
+  bool ik_tiers_changed_; // the workers need to load new solvers
+  std::vector<int> ik_tier_solved_; // per tier, grasps solved in the last request
+  boost::shared_ptr<pluginlib::ClassLoader<kinematics::KinematicsBase> > kin_class_loader_;
+
+  // racing several seeds per pose, the state below is per request and guarded by its lock
+  IkHedgeSettings hedge_settings_;
+  std::vector<char> hedge_solved_; // per candidate, whether a seed has won
+  double hedge_cpu_used_; // solver seconds spent, plus the timeouts of the queries running against the budget
+  std::vector<int> hedge_wins_; // per seed type
+  std::vector<double> current_state_seed_; // for SEED_CURRENT_STATE
+
+  // storage used by the filterGrasps() overloads that do not take an arena
+  GraspArena arena_;
+
+  // the other arm's candidates in filterMirroredGrasps(), with and without a mirrored solution
+  GraspCandidates mirrored_candidates_;
+  GraspCandidates unseeded_candidates_;
+  std::vector<double> mirrored_seeds_;
+  std::vector<double> mirrored_seed_; // the seed database's answer for one candidate
+
+  // for refining feasible candidates in filterGraspsAdaptive()
+  GraspGeneratorCore generator_core_;
+  GraspCandidates refine_parents_;
+
+  // candidates dropped by generateGrasps() as symmetric to a kept one
+  GraspCandidates symmetric_variants_;
+
+  // when streaming, generated grasps flow to the workers and feasible grasps back
+  BoundedQueue<std::size_t> candidate_queue_;
+  BoundedQueue<std::size_t> result_queue_;
+
+  // runs the asynchronous requests, created on first use
+  GraspExecutorPtr executor_;
+
+  // latency of every stage
+  GraspStatisticsPtr statistics_;
+
+  // IK outcomes since the last summary was logged
+  LogSummary log_summary_;
+
+  // blocks followed by updateTrackedGrasps(), by object id
+  TrackingSettings tracking_settings_;
+  std::map<std::string, TrackedObjectPtr> tracked_objects_;
+  GraspCandidates tracked_variants_;
+  std::size_t arena_seeded_end_; // candidates below this are seeded with their arena solution in the current request
 
   // whether to publish grasp info to rviz
   bool rviz_verbose_;
 
-  // class for publishing stuff to rviz
+  // class for publishing stuff to rviz, NULL when running without a planning scene
   moveit_visual_tools::VisualToolsPtr visual_tools_;
 
+  // stands in for the planning scene's current state when there is no planning scene
+  robot_state::RobotStatePtr default_state_;
+
 public:
 
   // Constructor
   GraspFilter( const std::string& base_link, bool rviz_verbose, 
     moveit_visual_tools::VisualToolsPtr rviz_tools, const std::string& planning_group );
 
+  /**
+   * \brief Constructor for running without a planning scene or rviz, e.g. in benchmarks. The robot's default
+   *        joint positions are used as its current state
+   */
+  GraspFilter( const std::string& base_link, robot_model::RobotModelConstPtr robot_model,
+    const std::string& planning_group );
+
   // Destructor
   ~GraspFilter();
 
@@ -137,10 +394,424 @@ public:
   // Choose the 1st grasp that is kinematically feasible
   bool filterGrasps(std::vector<moveit_msgs::Grasp>& possible_grasps);
 
+  /**
+   * \brief Remove the candidates that are not kinematically feasible, keeping the order of the rest.
+   *        Filter before converting to moveit_msgs::Grasp so only the survivors are converted
+   * \param possible_grasps - generated by BlockGraspGenerator, filtered in place
+   * \return true on success
+   */
+  bool filterGrasps(GraspCandidates& possible_grasps);
+
+  /**
+   * \brief Remove the candidates of a request that are not kinematically feasible and keep the
+   *        IK solution of the others. Does not allocate once the arena and the solvers are warmed up
+   * \param arena - holds the candidates, filtered in place. Reset it between requests
+   * \return true on success
+   */
+  bool filterGrasps(GraspArena& arena);
+
+  /**
+   * \brief Same as above for the candidates of a single block, which also records which slots of the sweeps were
+   *        feasible for it in the slot history, see setSlotHistory()
+   * \param block_pose - the block the arena's candidates were generated for
+   */
+  bool filterGrasps(const Eigen::Affine3d& block_pose, GraspArena& arena);
+
+  /**
+   * \brief filterGrasps(GraspCandidates&) for the candidates of a single block, recording the slot history
+   */
+  bool filterGrasps(const Eigen::Affine3d& block_pose, GraspCandidates& possible_grasps);
+
+  /**
+   * \brief Non-blocking filterGrasps(GraspArena&), runs on getExecutor() once the candidates are ready, e.g.
+   *        chained after BlockGraspGenerator::generateGraspsAsync(). Do not call the blocking functions of this
+   *        filter until the future is ready
+   * \param candidates - future of the arena to filter in place
+   * \return future of the same arena, holding the feasible grasps. Empty if filtering failed
+   */
+  boost::shared_future<GraspArenaPtr> filterGraspsAsync(const boost::shared_future<GraspArenaPtr>& candidates);
+
+  /**
+   * \brief Non-blocking filterGrasps(GraspArena&) for candidates that are already generated
+   */
+  boost::shared_future<GraspArenaPtr> filterGraspsAsync(GraspArenaPtr arena);
+
+  /**
+   * \brief The thread asynchronous requests run on. Share it with the BlockGraspGenerator so that generation
+   *        and filtering are chained without waiting. Selection can be chained with GraspExecutor::then()
+   */
+  GraspExecutorPtr getExecutor();
+
+  void setExecutor(GraspExecutorPtr executor)
+  {
+    executor_ = executor;
+  }
+
+  /**
+   * \brief Coarse-to-fine version of filterGrasps(). The arena should hold the coarse sweep generated at
+   *        geometry.angle_resolution_. Angles that are feasible (or score above geometry.refine_quality_threshold_)
+   *        are refined at twice the resolution and checked again, up to geometry.max_angle_resolution_
+   * \param block_pose - the block the arena's candidates were generated for
+   * \param geometry - see BlockGraspGenerator::getGraspGeometry()
+   * \param request_id - for the ids of the refined candidates
+   * \param arena - holds the coarse candidates, the feasible candidates of all resolutions when done
+   * \return true on success
+   */
+  bool filterGraspsAdaptive(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+                            uint32_t request_id, GraspArena& arena);
+
+  /**
+   * \brief Generate the candidates of a block like BlockGraspGenerator::generateGrasps() does: ordered by the arm
+   *        base, without symmetric duplicates and pruned by the slot history, ready for filterGrasps()
+   * \param block_pose - the block to grasp
+   * \param geometry - see BlockGraspGenerator::getGraspGeometry()
+   * \param request_id - for the ids of the candidates
+   * \param arena - reset, then holds the candidates
+   * \return true on success
+   */
+  bool generateGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry, uint32_t request_id,
+                      GraspArena& arena);
+
+  /**
+   * \brief Whether streamGrasps() checks the same candidates as generateGrasps() followed by filterGrasps(), i.e.
+   *        the geometry asks for no ordering by the arm base, no symmetry deduplication and no adaptive sampling
+   */
+  static bool canStream(const GraspGeometry& geometry);
+
+  /**
+   * \brief Generate and filter at the same time: every angle's candidates are handed to the IK threads
+   *        through a bounded queue as soon as they are generated, and every feasible grasp is passed to the
+   *        callback as soon as it is found, on the calling thread. Candidates are checked in generation order,
+   *        so they are not ordered by the arm base, deduplicated by symmetry or refined, see canStream()
+   * \param block_pose - the block to grasp
+   * \param geometry - see BlockGraspGenerator::getGraspGeometry()
+   * \param request_id - for the ids of the candidates
+   * \param callback - receives each feasible grasp, may be empty
+   * \param arena - reset, then holds the feasible grasps and their solutions when done
+   * \return true on success
+   */
+  bool streamGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry, uint32_t request_id,
+                    const FeasibleGraspCallback& callback, GraspArena& arena);
+
+  /**
+   * \brief Keep the grasps of a block that is detected again every frame up to date. While the block moves less
+   *        than the tracking tolerances between updates, the grasps feasible at the last update move with it and
+   *        are checked again seeded with their previous IK solution, and only a few of the other candidates are
+   *        checked per update. Otherwise all candidates are generated and checked from scratch
+   * \param object_id - persistent id of the block, e.g. from perception
+   * \param block_pose - the block's current pose
+   * \param geometry - see BlockGraspGenerator::getGraspGeometry()
+   * \param request_id - for the ids of the candidates when generating from scratch
+   * \param arena - reset, then holds the feasible grasps and their solutions when done
+   * \return true on success
+   */
+  bool updateTrackedGrasps(const std::string& object_id, const Eigen::Affine3d& block_pose,
+                           const GraspGeometry& geometry, uint32_t request_id, GraspArena& arena);
+
+  /**
+   * \brief Evaluate a block for both arms of a mirror-symmetric robot. This filter's arm is solved in full. Every
+   *        candidate of the other arm is mirrored, and if the seed database knows a solution of this arm close to
+   *        the mirrored pose, e.g. one just found, the mirrored solution seeds a short check on the other arm.
+   *        The seed database needs to be set
+   * \param symmetry - maps this arm to the other one
+   * \param mirrored_filter - the other arm's filter, with the same number of joints
+   * \param arena - this arm's candidates for the block, then its feasible grasps as by filterGrasps()
+   * \param mirrored_arena - the other arm's candidates for the same block, then its feasible grasps, the ones
+   *        verified from a mirrored solution first
+   * \return true on success
+   */
+  bool filterMirroredGrasps(const ArmSymmetry& symmetry, GraspFilter& mirrored_filter, GraspArena& arena,
+                            GraspArena& mirrored_arena);
+
+  /**
+   * \brief While set, running and new requests skip their remaining candidates and return with the feasible
+   *        grasps found so far, e.g. when another arm has already found enough. Can be called from any thread,
+   *        including a FeasibleGraspCallback. Clear it before the next request
+   */
+  void cancelRequests(bool cancel)
+  {
+    cancelled_ = cancel;
+  }
+
+  /**
+   * \brief Stop tracking a block, the next update of it starts from scratch
+   */
+  void forgetTrackedObject(const std::string& object_id)
+  {
+    tracked_objects_.erase(object_id);
+  }
+
+  void setTrackingSettings(const TrackingSettings& tracking_settings)
+  {
+    tracking_settings_ = tracking_settings;
+  }
+
+  const TrackingSettings& getTrackingSettings() const
+  {
+    return tracking_settings_;
+  }
+
+  /**
+   * \brief Position of the root of the planning group in the current robot state, for
+   *        RobotGraspData::arm_base_position_
+   * \return false if the group has no links
+   */
+  bool getArmBasePosition(Eigen::Vector3d& position) const;
+
+  /**
+   * \brief Use a different seed database, e.g. one shared between filters or loaded from a file.
+   *        Every IK query is seeded with the solution of the closest pose the database knows for the
+   *        planning group, and every solution found is added to it
+   * \param seed_database - NULL to seed each thread with its previous solution only
+   */
+  void setSeedDatabase(IkSeedDatabasePtr seed_database)
+  {
+    seed_database_ = seed_database;
+  }
+
+  IkSeedDatabasePtr getSeedDatabase() const
+  {
+    return seed_database_;
+  }
+
+  /**
+   * \brief Learn the timeouts from a model, e.g. one loaded from a file. Every query of a tier without its own
+   *        timeout gets the timeout the model derives from the solve times of similar poses, and its outcome
+   *        is added to the model. Off by default
+   * \param timeout_model - NULL to give every query the fixed timeout of setIkTimeout()
+   */
+  void setTimeoutModel(IkTimeoutModelPtr timeout_model)
+  {
+    timeout_model_ = timeout_model;
+  }
+
+  IkTimeoutModelPtr getTimeoutModel() const
+  {
+    return timeout_model_;
+  }
+
+  /**
+   * \brief Seconds per IK query when the timeout model knows too little about a pose
+   * \param timeout - <=0 for the planning group's timeout from kinematics.yaml
+   */
+  void setIkTimeout(double timeout)
+  {
+    ik_timeout_ = timeout;
+  }
+
+  double getIkTimeout() const
+  {
+    return ik_timeout_;
+  }
+
+  /**
+   * \brief Record which slots of the sweeps are feasible, and have streamGrasps() skip, or try last, the slots
+   *        that have almost never been. Requests that know their block record into it: streamGrasps(),
+   *        filterGraspsAdaptive() and the filterGrasps() overloads that take a block pose. Share it with the
+   *        BlockGraspGenerator of the same arm so that it prunes before filtering, see GraspSlotHistory
+   * \param slot_history - NULL to try every slot and record nothing
+   */
+  void setSlotHistory(GraspSlotHistoryPtr slot_history)
+  {
+    slot_history_ = slot_history;
+  }
+
+  GraspSlotHistoryPtr getSlotHistory() const
+  {
+    return slot_history_;
+  }
+
+  /**
+   * \brief Race several seeds per pose, see IkHedgeSettings. Takes effect on the next request
+   */
+  void setHedgeSettings(const IkHedgeSettings& hedge_settings)
+  {
+    hedge_settings_ = hedge_settings;
+  }
+
+  const IkHedgeSettings& getHedgeSettings() const
+  {
+    return hedge_settings_;
+  }
+
+  /**
+   * \brief Control how many IK threads a request uses. The pool is resized on the next request
+   */
+  void setConcurrencySettings(const ConcurrencySettings& concurrency_settings)
+  {
+    concurrency_settings_ = concurrency_settings;
+    pool_changed_ = true;
+  }
+
+  const ConcurrencySettings& getConcurrencySettings() const
+  {
+    return concurrency_settings_;
+  }
+
+  /**
+   * \brief Restrict the IK threads to a set of cores and give them a scheduling policy. Requests then always
+   *        run on the IK threads, never on the calling thread. The pool is restarted on the next request
+   */
+  void setWorkerScheduling(const WorkerSchedulingSettings& scheduling_settings)
+  {
+    scheduling_settings_ = scheduling_settings;
+    pool_changed_ = true;
+  }
+
+  const WorkerSchedulingSettings& getWorkerScheduling() const
+  {
+    return scheduling_settings_;
+  }
+
+  /**
+   * \brief Read the worker scheduling from the parameters cpu_set (list of core indices), pin_workers (bool),
+   *        scheduling_policy ("other", "batch", "idle", "fifo" or "rr") and priority (int) of a node handle
+   * \return false if a parameter is invalid, nothing is changed then
+   */
+  bool loadWorkerScheduling(const ros::NodeHandle& nh);
+
+  /**
+   * \brief Where the latencies of IK and result assembly and the IK outcomes are recorded
+   */
+  GraspStatisticsPtr getStatistics() const
+  {
+    return statistics_;
+  }
+
+  void setStatistics(GraspStatisticsPtr statistics)
+  {
+    statistics_ = statistics;
+  }
+
+  /**
+   * \brief Seconds between the summaries of the IK outcomes that are logged at info level, <=0 to log every
+   *        request. The details of every request and grasp are debug messages
+   */
+  void setLogSummaryPeriod(double period)
+  {
+    log_summary_.setPeriod(period);
+  }
+
+  /**
+   * \brief Create the group's solvers with this instead of the kinematics plugin loader, e.g. with
+   *        MockKinematics::getAllocator(). The pool is restarted on the next request
+   */
+  void setSolverAllocator(const robot_model::SolverAllocatorFn& solver_allocator)
+  {
+    solver_allocator_ = solver_allocator;
+    pool_changed_ = true;
+  }
+
+  /**
+   * \brief Running estimate of the seconds one IK query takes, <=0 before the first request
+   */
+  double getIkLatencyEstimate() const
+  {
+    return ik_latency_estimate_;
+  }
+
+  /**
+   * \brief Try a chain of solvers in order for every grasp until one finds a solution. The tier that solved
+   *        each grasp is recorded with GraspArena::setIkTier(). Solvers are loaded on the next request
+   * \param ik_tiers - by default a single tier with the group's solver
+   */
+  void setIkTiers(const std::vector<IkTier>& ik_tiers)
+  {
+    ik_tiers_ = ik_tiers;
+    ik_tiers_changed_ = true;
+  }
+
+  const std::vector<IkTier>& getIkTiers() const
+  {
+    return ik_tiers_;
+  }
+
 private:
 
+  // Body of filterGraspsAsync()
+  GraspArenaPtr filterGraspsTask(const GraspArenaPtr& arena);
+
+  // Find the kinematically feasible candidates from first_id on and add them to the arena's filtered ids, sorted.
+  // With a block pose the results are recorded in the slot history
+  bool filterGraspIds(GraspArena& arena, std::size_t first_id, const Eigen::Affine3d* block_pose = NULL);
+
+  // Body of the filterGrasps() overloads that take an arena
+  bool filterArena(GraspArena& arena, const Eigen::Affine3d* block_pose);
+
+  // Check all of the arena's candidates seeded with their arena solution, with a fixed timeout that the
+  // timeout model neither overrides nor learns from
+  bool verifySeededGrasps(GraspArena& arena, double timeout);
+
+  // Load the solvers and reset the per request state for an arena of up to num_candidates candidates,
+  // of which the ones from first_id on need checking. Sets the number of shares of work and the timeout
+  bool prepareIkRequest(GraspArena& arena, std::size_t first_id, std::size_t num_candidates, bool streaming,
+                        int& num_threads, double& timeout);
+
+  // Give every worker a share of [first_id, end_id), or the queues when streaming
+  void assignIkJobs(GraspArena& arena, std::size_t first_id, std::size_t end_id, int num_threads, double timeout,
+                    boost::mutex* lock, bool streaming);
+
+  // Number of threads for a request with num_grasps grasps to check
+  int chooseNumThreads(std::size_t num_grasps, double timeout) const;
+
+  // Seeds raced per grasp, always one when streaming
+  int getNumSeeds(bool streaming) const;
+
+  // Number of threads whose solvers are loaded
+  int getMaxThreads() const;
+
+  // Number of cores the IK threads may use
+  int getNumCores() const;
+
+  // Apply the worker scheduling to the calling thread
+  void applyWorkerScheduling(int thread_id);
+
+  // Run the jobs of the first num_workers workers, on the calling thread if there is only one
+  void runIkJobs(int num_workers);
+
+  // Wake up the first num_workers workers on their jobs
+  void startIkJobs(int num_workers);
+
+  // Wait for the workers to finish their jobs
+  void waitIkJobs();
+
+  // Collect the solved candidates from first_id on into the filtered ids in candidate order, so the result does
+  // not depend on thread timing, and log the results of a request. With a block pose the results are recorded in
+  // the slot history, unless the request was cancelled
+  void finishIkRequest(GraspArena& arena, std::size_t first_id, const Eigen::Affine3d* block_pose = NULL);
+
+  // Create the solvers and a thread for each worker, stopping the previous ones
+  bool loadIkWorkers(int num_threads);
+
+  // The planning scene's current state, or the default state without a planning scene
+  const robot_state::RobotState& getCurrentState() const;
+
+  // Create the solver of one tier. Tiers without a plugin of their own share the worker's default solver, which
+  // also tells the other plugins which chain to solve for
+  kinematics::KinematicsBasePtr loadIkSolver(const IkTier& ik_tier,
+                                             const kinematics::KinematicsBasePtr& default_solver);
+
+  // Stop and join all worker threads
+  void stopIkWorkers();
+
+  // Main loop of a worker thread, waits for requests newer than last_job_count that it takes part in
+  void ikWorkerThread(int thread_id, unsigned long last_job_count);
+
   // Thread for checking part of the possible grasps list
-  void filterGraspThread(IkThreadStruct ik_thread_struct);
+  void filterGraspThread(IkWorker& worker);
+
+  // Fill the worker's seed state according to its seed type
+  void chooseSeed(IkWorker& worker, std::size_t candidate, const Eigen::Affine3d& grasp_pose);
+
+  // Whether a block moved little enough since the last update to keep tracking its grasps
+  bool isTracked(const TrackedObject& tracked, const Eigen::Affine3d& block_pose) const;
+
+  // Run IK for one candidate through the tiers, when hedging only until another
+  // seed has won. Returns the tier that found a solution or -1
+  int searchIk(IkWorker& worker, std::size_t candidate, const geometry_msgs::Pose& ik_pose);
+
+  // Run one tier's solver, see searchIk()
+  bool searchIkTier(IkWorker& worker, std::size_t candidate, const geometry_msgs::Pose& ik_pose, int tier);
 
 
 }; // end of class
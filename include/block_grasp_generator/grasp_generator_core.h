@@ -0,0 +1,251 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   ROS-independent core of the grasp generator, so that it can be used in-process without messages
+//         or a running node. The geometry only depends on Eigen. The rest of the core library also uses
+//         Boost: shared pointers for GraspArena and Boost.Thread for GraspSlotHistory.
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_GENERATOR_CORE_
+#define BLOCK_GRASP_GENERATOR__GRASP_GENERATOR_CORE_
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+// Grasp ids
+#include <block_grasp_generator/grasp_id.h>
+
+// C++
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <math.h>
+#define _USE_MATH_DEFINES
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief The subset of a robot's grasp data that the geometry needs
+ */
+struct GraspGeometry
+{
+  GraspGeometry() :
+    grasp_pose_to_eef_pose_(Eigen::Affine3d::Identity()),
+    grasp_depth_(0.12),
+    angle_resolution_(16),
+    max_angle_resolution_(0),
+    refine_quality_threshold_(0),
+    block_symmetry_order_(4),
+    gripper_symmetry_order_(2),
+    symmetry_position_tolerance_(0.01),
+    symmetry_angle_tolerance_(0),
+    face_arm_base_(false),
+    arm_base_position_(Eigen::Vector3d::Zero()),
+    min_arm_base_alignment_(-1)
+  {}
+  Eigen::Affine3d grasp_pose_to_eef_pose_; // Convert generic grasp pose to this end effector's frame of reference
+  double grasp_depth_; // distance from center point of object to end effector
+  int angle_resolution_; // generate grasps at PI/angle_resolution increments
+  int max_angle_resolution_; // adaptive sampling refines feasible angles up to PI/max_angle_resolution (<= angle_resolution_ to disable)
+  double refine_quality_threshold_; // adaptive sampling also refines infeasible angles scoring at least this (<=0 to disable)
+  int block_symmetry_order_; // the block looks the same after rotating 2*PI/order around its z axis
+  int gripper_symmetry_order_; // the gripper grasps the same after rotating 2*PI/order around its approach axis
+  double symmetry_position_tolerance_; // grasps closer than this (meters) after applying symmetries are equivalent
+  double symmetry_angle_tolerance_; // grasps closer than this (radians) after applying symmetries are equivalent (<=0 to disable)
+  bool face_arm_base_; // order candidates so the wrist faces back toward the arm base first
+  Eigen::Vector3d arm_base_position_; // in the base frame, e.g. the root of the planning group
+  double min_arm_base_alignment_; // when facing the arm base, drop candidates less aligned than this, in [-1, 1]
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * \brief One generated grasp, before it is converted to a moveit_msgs::Grasp
+ */
+struct GraspCandidate
+{
+  Eigen::Affine3d grasp_pose_; // pose of the end effector in the base frame
+  GraspId id_; // how this candidate was generated
+  GraspId canonical_id_; // id_ of the equivalent candidate that was kept, see removeSymmetricGrasps()
+  double grasp_quality_; // how "good" the grasp is, see GraspGeneratorCore::scoreGrasp()
+  grasp_axis_t axis_;
+  grasp_direction_t direction_;
+  int angle_index_; // position in the sweep, at PI/angle_resolution increments
+  grasp_approach_t approach_;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<GraspCandidate, Eigen::aligned_allocator<GraspCandidate> > GraspCandidates;
+
+/**
+ * \brief Working memory of refineGrasps() and the prefilters. Keep one per thread between requests, e.g. the one
+ *        of a GraspArena, so that they stop allocating once it has grown to the request size
+ */
+struct GraspScratch
+{
+  typedef std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > Transforms;
+
+  std::vector<GraspId> children_; // refineGrasps()
+  Transforms block_symmetries_; // removeSymmetricGrasps()
+  Transforms gripper_symmetries_;
+  Transforms images_;
+  std::vector<std::size_t> image_owners_;
+  std::vector<std::size_t> order_;
+  std::vector<char> keep_;
+  std::vector<std::pair<double, std::size_t> > alignments_; // orderByArmBase()
+  GraspCandidates sorted_;
+};
+
+// Class
+class GraspGeneratorCore
+{
+public:
+
+  // Constructor
+  GraspGeneratorCore();
+
+  // Destructor
+  ~GraspGeneratorCore();
+
+  /**
+   * \brief Create all possible grasp positions for a block
+   * \param block_pose - transform from the block's frame (center of block) to the base link
+   * \param geometry - custom settings for a robot's geometry
+   * \param request_id - becomes part of every candidate's id
+   * \param candidates - result is appended to this
+   * \return false if geometry.angle_resolution_ is not in [1, GraspId::MAX_ANGLE_RESOLUTION]
+   */
+  bool generateGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry, uint32_t request_id,
+                      GraspCandidates& candidates) const;
+
+  /**
+   * \brief Number of candidates generateGrasps() creates, for reserving memory
+   */
+  static std::size_t getNumGrasps(const GraspGeometry& geometry);
+
+  /**
+   * \brief Create grasp positions in one axis
+   * \return false if the axis is not supported
+   */
+  bool generateAxisGrasps(const Eigen::Affine3d& block_pose, grasp_axis_t axis, grasp_direction_t direction,
+                          const GraspGeometry& geometry, uint32_t request_id, GraspCandidates& candidates) const;
+
+  /**
+   * \brief Create the candidates of a single angle of a sweep, one per approach
+   * \param angle_index - the angle is angle_index * PI / angle_resolution
+   * \return false if the axis is not supported or angle_resolution is not in [1, GraspId::MAX_ANGLE_RESOLUTION]
+   */
+  bool generateAngleGrasps(const Eigen::Affine3d& block_pose, grasp_axis_t axis, grasp_direction_t direction,
+                           int angle_index, int angle_resolution, const GraspGeometry& geometry,
+                           uint32_t request_id, GraspCandidates& candidates) const;
+
+  /**
+   * \brief Coarse-to-fine sampling: create the candidates halfway between each parent's angle and its
+   *        neighbors, at twice the parents' resolution. Angles shared by several parents are only created once.
+   *        Parents whose resolution can not be doubled within GraspId::MAX_ANGLE_RESOLUTION are not refined
+   * \param parents - candidates that were all generated at the same angle resolution
+   * \param candidates - result is appended to this
+   * \param scratch - working memory to reuse, NULL to allocate it for this call
+   * \return number of candidates appended
+   */
+  std::size_t refineGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry, uint32_t request_id,
+                           const GraspCandidates& parents, GraspCandidates& candidates,
+                           GraspScratch* scratch = NULL) const;
+
+  /**
+   * \brief Drop candidates that are equivalent to another one under the block's and the gripper's symmetry,
+   *        within geometry's symmetry tolerances. Of each set of equivalent candidates the highest scoring
+   *        (first generated on ties) is kept. Does nothing if geometry.symmetry_angle_tolerance_ <= 0
+   * \param block_pose - the block the candidates were generated for
+   * \param first_id - only candidates from this index on are considered
+   * \param candidates - filtered in place, order is kept
+   * \param variants - the dropped candidates are appended to this, see getSymmetricVariants()
+   * \param scratch - working memory to reuse, NULL to allocate it for this call
+   * \return number of candidates dropped
+   */
+  std::size_t removeSymmetricGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+                                    std::size_t first_id, GraspCandidates& candidates,
+                                    GraspCandidates& variants, GraspScratch* scratch = NULL) const;
+
+  /**
+   * \brief How much a candidate's wrist faces back toward the arm base: 1 when it is on the robot's side of
+   *        the block, -1 on the far side and 0 straight above it
+   */
+  static double getArmBaseAlignment(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+                                    const GraspCandidate& candidate);
+
+  /**
+   * \brief Sort candidates so the ones whose wrist faces the arm base come first and drop the ones aligned
+   *        less than geometry.min_arm_base_alignment_. Run this before removeSymmetricGrasps() so that of
+   *        equivalent candidates the one facing the robot is kept. Does nothing unless geometry.face_arm_base_
+   * \param first_id - only candidates from this index on are considered
+   * \param scratch - working memory to reuse, NULL to allocate it for this call
+   * \return number of candidates dropped
+   */
+  std::size_t orderByArmBase(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+                             std::size_t first_id, GraspCandidates& candidates,
+                             GraspScratch* scratch = NULL) const;
+
+  /**
+   * \brief Recover the candidates removeSymmetricGrasps() dropped in favor of a kept one, e.g. when the kept
+   *        grasp needs an alternate wrist orientation
+   * \param canonical - id_ of the kept candidate
+   * \param variants - as filled by removeSymmetricGrasps()
+   * \param result - matching variants are appended to this
+   */
+  static void getSymmetricVariants(const GraspId& canonical, const GraspCandidates& variants,
+                                   GraspCandidates& result);
+
+  /**
+   * \brief Pose of the generic grasp frame in the block's frame, before conversion to the end effector
+   * \param theta - where the point is located around the block
+   * \return false if the axis is not supported
+   */
+  static bool computeBlockGraspPose(grasp_axis_t axis, grasp_direction_t direction, double theta,
+                                    double radius, Eigen::Affine3d& grasp_pose);
+
+  /**
+   * \brief The estimated probability of success for a grasp at angle theta
+   */
+  static double scoreGrasp(double theta);
+
+}; // end of class
+
+} // namespace
+
+#endif
@@ -0,0 +1,156 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Compact, deterministic identifier of a generated grasp
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_ID_
+#define BLOCK_GRASP_GENERATOR__GRASP_ID_
+
+// C++
+#include <string>
+#include <stdint.h>
+
+namespace block_grasp_generator
+{
+
+// Grasp axis orientation
+enum grasp_axis_t {X_AXIS, Y_AXIS, Z_AXIS};
+enum grasp_direction_t {UP, DOWN};
+
+// Frame the approach and retreat motions are expressed in
+enum grasp_approach_t
+{
+  APPROACH_BASE_FRAME, // straight down with respect to the base link
+  APPROACH_EEF_FRAME   // angled with the pose of the end effector
+};
+
+/**
+ * \brief Identifies a grasp by how it was generated, packed into 64 bits so that the generator
+ *        never has to format strings. The same request generates the same ids on every run.
+ *
+ *        bits  0     approach
+ *        bits  1     direction
+ *        bits  2-3   axis
+ *        bits  4-17  angle index
+ *        bits 18-31  angle resolution
+ *        bits 32-63  request id
+ *
+ *        Resolutions above MAX_ANGLE_RESOLUTION do not fit, the generator rejects them
+ */
+class GraspId
+{
+private:
+  uint64_t value_;
+
+public:
+
+  static const int MAX_ANGLE_RESOLUTION = 0x3FFF;
+
+  GraspId()
+    : value_(0)
+  {
+  }
+
+  GraspId(uint32_t request_id, grasp_axis_t axis, grasp_direction_t direction, int angle_index,
+          int angle_resolution, grasp_approach_t approach)
+    : value_((uint64_t(request_id) << 32) |
+             (uint64_t(angle_resolution & MAX_ANGLE_RESOLUTION) << 18) |
+             (uint64_t(angle_index & MAX_ANGLE_RESOLUTION) << 4) |
+             (uint64_t(axis & 0x3) << 2) |
+             (uint64_t(direction & 0x1) << 1) |
+             uint64_t(approach & 0x1))
+  {
+  }
+
+  uint64_t getValue() const
+  {
+    return value_;
+  }
+
+  uint32_t getRequestId() const
+  {
+    return uint32_t(value_ >> 32);
+  }
+
+  int getAngleResolution() const
+  {
+    return int((value_ >> 18) & MAX_ANGLE_RESOLUTION);
+  }
+
+  int getAngleIndex() const
+  {
+    return int((value_ >> 4) & MAX_ANGLE_RESOLUTION);
+  }
+
+  grasp_axis_t getAxis() const
+  {
+    return grasp_axis_t((value_ >> 2) & 0x3);
+  }
+
+  grasp_direction_t getDirection() const
+  {
+    return grasp_direction_t((value_ >> 1) & 0x1);
+  }
+
+  grasp_approach_t getApproach() const
+  {
+    return grasp_approach_t(value_ & 0x1);
+  }
+
+  /**
+   * \brief Human readable form, e.g. "Grasp_r3_Y_DOWN_a5of16_eef". Only call this at the API boundary
+   */
+  std::string toString() const;
+
+  bool operator==(const GraspId& other) const
+  {
+    return value_ == other.value_;
+  }
+
+  bool operator!=(const GraspId& other) const
+  {
+    return value_ != other.value_;
+  }
+
+  bool operator<(const GraspId& other) const
+  {
+    return value_ < other.value_;
+  }
+
+}; // end of class
+
+} // namespace
+
+#endif
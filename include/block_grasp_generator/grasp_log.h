@@ -0,0 +1,177 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Logging levels that can be compiled out, and summaries of many requests logged at a limited rate
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_LOG_
+#define BLOCK_GRASP_GENERATOR__GRASP_LOG_
+
+// ROS
+#include <ros/ros.h>
+
+// C++
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+// Levels below BLOCK_GRASP_GENERATOR_MIN_LOG_LEVEL are compiled out
+#define GRASP_LOG_LEVEL_GRASP 0 // every candidate, e.g. the pose, seed and outcome of every IK call
+#define GRASP_LOG_LEVEL_DEBUG 1 // every request
+#define GRASP_LOG_LEVEL_INFO 2 // setup and summaries
+
+// Set by CMakeLists.txt. Whatever the build type, the per grasp diagnostics cost nothing unless asked for,
+// e.g. catkin_make -DBLOCK_GRASP_GENERATOR_MIN_LOG_LEVEL=0
+#ifndef BLOCK_GRASP_GENERATOR_MIN_LOG_LEVEL
+#define BLOCK_GRASP_GENERATOR_MIN_LOG_LEVEL GRASP_LOG_LEVEL_DEBUG
+#endif
+
+// When compiled in, both are ROS debug messages so they are still off unless the logger is set to debug
+#if BLOCK_GRASP_GENERATOR_MIN_LOG_LEVEL <= GRASP_LOG_LEVEL_GRASP
+#define GRASP_LOG_GRASP_STREAM(name, args) ROS_DEBUG_STREAM_NAMED(name, args)
+#else
+#define GRASP_LOG_GRASP_STREAM(name, args) do {} while(false)
+#endif
+
+#if BLOCK_GRASP_GENERATOR_MIN_LOG_LEVEL <= GRASP_LOG_LEVEL_DEBUG
+#define GRASP_LOG_DEBUG_STREAM(name, args) ROS_DEBUG_STREAM_NAMED(name, args)
+#else
+#define GRASP_LOG_DEBUG_STREAM(name, args) do {} while(false)
+#endif
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief Streams a joint vector on a single line, e.g. GRASP_LOG_GRASP_STREAM("grasp", "seed " << LogJoints(seed))
+ */
+class LogJoints
+{
+public:
+  explicit LogJoints(const std::vector<double>& joints)
+    : joints_(joints)
+  {
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, const LogJoints& log_joints)
+  {
+    out << "[";
+    for (std::size_t i = 0; i < log_joints.joints_.size(); ++i)
+      out << (i > 0 ? ", " : "") << log_joints.joints_[i];
+    return out << "]";
+  }
+
+private:
+  const std::vector<double>& joints_;
+};
+
+/**
+ * \brief Adds up counts over many requests and says when they are due to be logged, so that a busy node logs
+ *        one line per period instead of several per request. Not thread safe
+ */
+class LogSummary
+{
+public:
+
+  /**
+   * \param period - seconds between summaries, <=0 to log every request
+   * \param num_counts - counts kept, e.g. NUM_GRASP_COUNTERS
+   */
+  LogSummary(double period, std::size_t num_counts)
+    : period_(period),
+      last_time_(ros::WallTime::now()),
+      requests_(0),
+      counts_(num_counts, 0)
+  {
+  }
+
+  void add(std::size_t index, boost::uint64_t count)
+  {
+    counts_[index] += count;
+  }
+
+  /**
+   * \brief Count a finished request
+   * \return true if the period has passed, log getCount() and getRequests() then call reset()
+   */
+  bool addRequest()
+  {
+    ++requests_;
+    return period_ <= 0 || (ros::WallTime::now() - last_time_).toSec() >= period_;
+  }
+
+  void reset()
+  {
+    last_time_ = ros::WallTime::now();
+    requests_ = 0;
+    std::fill(counts_.begin(), counts_.end(), 0);
+  }
+
+  boost::uint64_t getCount(std::size_t index) const
+  {
+    return counts_[index];
+  }
+
+  boost::uint64_t getRequests() const
+  {
+    return requests_;
+  }
+
+  // Seconds covered by the summary
+  double getDuration() const
+  {
+    return (ros::WallTime::now() - last_time_).toSec();
+  }
+
+  void setPeriod(double period)
+  {
+    period_ = period;
+  }
+
+  double getPeriod() const
+  {
+    return period_;
+  }
+
+private:
+  double period_;
+  ros::WallTime last_time_; // of the last summary
+  boost::uint64_t requests_;
+  std::vector<boost::uint64_t> counts_;
+};
+
+} // namespace
+
+#endif
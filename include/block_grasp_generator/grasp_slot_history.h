@@ -0,0 +1,194 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Remembers which slots of the grasp sweeps turned out feasible for blocks at a given place on the
+//         table, so that slots that almost never pass IK there can be skipped or tried last
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_SLOT_HISTORY_
+#define BLOCK_GRASP_GENERATOR__GRASP_SLOT_HISTORY_
+
+// Grasp geometry
+#include <block_grasp_generator/grasp_generator_core.h>
+#include <block_grasp_generator/grasp_arena.h>
+
+// C++
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <map>
+#include <vector>
+#include <cstddef>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief When GraspSlotHistory gives up on a slot
+ */
+struct GraspSlotSettings
+{
+  GraspSlotSettings() :
+    cell_size_(0.1),
+    yaw_bins_(8),
+    angle_bins_(16),
+    min_attempts_(20),
+    min_success_rate_(0.05),
+    explore_interval_(10),
+    drop_pruned_(true),
+    history_length_(500)
+  {}
+  double cell_size_; // meters, edge of the cubes the block position is binned in
+  int yaw_bins_; // sectors the block's rotation about z is binned in
+  int angle_bins_; // slots per sweep, angles of finer sweeps share the slot of the nearest angle
+  std::size_t min_attempts_; // candidates a slot needs before it can be pruned
+  double min_success_rate_; // slots feasible less often than this are pruned
+  std::size_t explore_interval_; // every this many requests of a cell prune nothing, so that pruned slots keep
+                                 // getting tried and can come back. 0 to never explore
+  bool drop_pruned_; // drop pruned candidates, or only move them after the others
+  std::size_t history_length_; // the counts of a slot are halved when it has seen this many candidates
+};
+
+/**
+ * \brief Feasibility statistics per template slot, i.e. axis, direction and sweep angle, and per block cell,
+ *        i.e. the block's position and rotation about z. Safe to use from the generator and the filter at once
+ */
+class GraspSlotHistory
+{
+public:
+
+  // Constructor
+  explicit GraspSlotHistory(const GraspSlotSettings& settings = GraspSlotSettings());
+
+  // Destructor
+  ~GraspSlotHistory();
+
+  /**
+   * \brief Count the IK results of a request's candidates, i.e. whether GraspArena::getIkTier() is set
+   * \param block_pose - the block the candidates were generated for
+   * \param first_id - only candidates from this index on are counted
+   */
+  void addResults(const Eigen::Affine3d& block_pose, const GraspArena& arena, std::size_t first_id);
+
+  /**
+   * \brief Count the IK result of a single candidate
+   */
+  void addResult(const Eigen::Affine3d& block_pose, const GraspCandidate& candidate, bool feasible);
+
+  /**
+   * \brief Which slots to prune for a new request of a block. Counts the request, so call it once per request
+   * \param pruned - resized to getNumSlots(), nonzero for the pruned slots
+   * \return false if nothing is pruned, e.g. because this request explores
+   */
+  bool getPrunedSlots(const Eigen::Affine3d& block_pose, std::vector<char>& pruned);
+
+  /**
+   * \brief Drop the candidates of the pruned slots, or move them after the others if the settings say so.
+   *        Order is kept otherwise. Counts the request like getPrunedSlots()
+   * \param first_id - only candidates from this index on are considered
+   * \return number of candidates dropped or moved
+   */
+  std::size_t pruneGrasps(const Eigen::Affine3d& block_pose, std::size_t first_id, GraspCandidates& candidates);
+
+  /**
+   * \brief Slot of a candidate, an index below getNumSlots()
+   */
+  int getSlot(grasp_axis_t axis, grasp_direction_t direction, int angle_index, int angle_resolution) const;
+
+  int getSlot(const GraspCandidate& candidate) const;
+
+  int getNumSlots() const
+  {
+    return 3 * 2 * (settings_.angle_bins_ + 1);
+  }
+
+  /**
+   * \brief Fraction of a slot's candidates that were feasible for blocks in the cell of block_pose
+   * \return false if the slot has never been tried there
+   */
+  bool getSuccessRate(const Eigen::Affine3d& block_pose, int slot, double& success_rate) const;
+
+  /**
+   * \brief Forget everything
+   */
+  void clear();
+
+  const GraspSlotSettings& getSettings() const
+  {
+    return settings_;
+  }
+
+private:
+
+  struct CellKey
+  {
+    int x_;
+    int y_;
+    int z_;
+    int yaw_;
+    bool operator<(const CellKey& other) const;
+  };
+
+  struct Cell
+  {
+    Cell() : requests_(0) {}
+    std::vector<boost::uint32_t> attempts_; // per slot
+    std::vector<boost::uint32_t> feasible_; // per slot
+    boost::uint64_t requests_;
+  };
+
+  typedef std::map<CellKey, Cell> CellMap;
+
+  // The cell of a block
+  CellKey getKey(const Eigen::Affine3d& block_pose) const;
+
+  // Count one candidate. Call with the mutex locked
+  void addResult(Cell& cell, int slot, bool feasible);
+
+  GraspSlotSettings settings_;
+  CellMap cells_;
+  mutable boost::mutex mutex_;
+
+  // Reused by pruneGrasps() so that it only allocates for the first requests
+  std::vector<char> pruned_slots_;
+  GraspCandidates pruned_candidates_;
+  boost::mutex prune_mutex_; // taken before mutex_, never after
+
+}; // end of class
+
+typedef boost::shared_ptr<GraspSlotHistory> GraspSlotHistoryPtr;
+
+} // namespace
+
+#endif
@@ -0,0 +1,211 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Latency histograms and counters of the grasp pipeline's stages, queryable from C++ and published
+//         periodically as diagnostics
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_STATISTICS_
+#define BLOCK_GRASP_GENERATOR__GRASP_STATISTICS_
+
+// ROS
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+// C++
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief Stages of generating and filtering grasps
+ */
+enum grasp_stage_t
+{
+  STAGE_GENERATE, // creating candidates around the block, including the transform to the base frame
+  STAGE_PREFILTER, // ordering by arm base and removing symmetric candidates
+  STAGE_CONVERT, // to moveit_msgs::Grasp
+  STAGE_IK_CALL, // a single query of a solver
+  STAGE_IK_REQUEST, // all IK of a request, including waiting for the threads
+  STAGE_ASSEMBLE, // collecting the feasible candidates of a request
+  STAGE_VISUALIZE,
+  NUM_GRASP_STAGES
+};
+
+/**
+ * \brief Events counted by the grasp pipeline
+ */
+enum grasp_counter_t
+{
+  COUNT_IK_SUCCESS,
+  COUNT_NO_IK_SOLUTION,
+  COUNT_TIMED_OUT,
+  COUNT_IK_ERROR, // any other error code
+  COUNT_SEED_CACHE_HIT, // IK seeded from a stored solution
+  COUNT_SEED_CACHE_MISS,
+  NUM_GRASP_COUNTERS
+};
+
+/**
+ * \brief Histogram of durations in the style of HdrHistogram: buckets grow exponentially and each is split
+ *        linearly into 16, so any percentile is within about 6% of the true value from 32 nanoseconds up to
+ *        about 18 minutes, in a fixed 5 kB. Recording is a few instructions and never allocates. Not thread safe,
+ *        give every thread its own and merge them
+ */
+class LatencyHistogram
+{
+public:
+
+  // Constructor
+  LatencyHistogram();
+
+  // Record one duration, in seconds
+  void record(double seconds)
+  {
+    recordNanoseconds(seconds > 0 ? boost::uint64_t(seconds * 1e9) : 0);
+  }
+
+  void recordNanoseconds(boost::uint64_t nanoseconds);
+
+  // Add the durations of another histogram
+  void merge(const LatencyHistogram& other);
+
+  void reset();
+
+  boost::uint64_t getCount() const
+  {
+    return count_;
+  }
+
+  /**
+   * \brief Duration below which percentile (in [0, 1]) of the recorded durations lie, in seconds. Reports the
+   *        upper end of the bucket, so it never understates. 0 if nothing was recorded
+   */
+  double getPercentile(double percentile) const;
+
+  // In seconds, 0 if nothing was recorded
+  double getMean() const;
+  double getMin() const;
+  double getMax() const;
+
+private:
+
+  static std::size_t getBucket(boost::uint64_t nanoseconds);
+  static boost::uint64_t getBucketEnd(std::size_t bucket);
+
+  std::vector<boost::uint64_t> buckets_;
+  boost::uint64_t count_;
+  double sum_; // seconds
+  boost::uint64_t min_; // nanoseconds
+  boost::uint64_t max_; // nanoseconds
+};
+
+/**
+ * \brief Thread safe collection of a histogram per stage and the counters, shared by a BlockGraspGenerator and
+ *        a GraspFilter. Threads that record often keep their own LatencyHistogram and merge it once per request
+ */
+class GraspStatistics
+{
+public:
+
+  // Constructor
+  GraspStatistics();
+
+  void recordStage(grasp_stage_t stage, double seconds);
+
+  void mergeStage(grasp_stage_t stage, const LatencyHistogram& histogram);
+
+  void addCount(grasp_counter_t counter, boost::uint64_t count = 1);
+
+  // Copy of a stage's histogram
+  LatencyHistogram getStage(grasp_stage_t stage) const;
+
+  boost::uint64_t getCount(grasp_counter_t counter) const;
+
+  // Forget everything recorded so far
+  void reset();
+
+  /**
+   * \brief Summary of every stage (count, mean, p50, p90, p99, max in milliseconds) and every counter
+   */
+  void getDiagnostics(diagnostic_msgs::DiagnosticStatus& status) const;
+
+  static const char* getStageName(grasp_stage_t stage);
+
+  static const char* getCounterName(grasp_counter_t counter);
+
+private:
+
+  mutable boost::mutex mutex_;
+  std::vector<LatencyHistogram> stages_;
+  std::vector<boost::uint64_t> counters_;
+};
+
+typedef boost::shared_ptr<GraspStatistics> GraspStatisticsPtr;
+
+/**
+ * \brief Publishes GraspStatistics on /diagnostics at a fixed period
+ */
+class GraspStatisticsPublisher
+{
+public:
+
+  /**
+   * \brief Constructor, starts publishing
+   * \param name - of the diagnostic status, e.g. the node and planning group
+   * \param period - seconds between messages
+   */
+  GraspStatisticsPublisher(GraspStatisticsPtr statistics, const std::string& name, double period);
+
+private:
+
+  void publishCallback(const ros::WallTimerEvent& event);
+
+  GraspStatisticsPtr statistics_;
+  std::string name_;
+  ros::NodeHandle nh_;
+  ros::Publisher diagnostics_pub_;
+  ros::WallTimer publish_timer_;
+  diagnostic_msgs::DiagnosticArray diagnostics_; // reused between messages
+};
+
+typedef boost::shared_ptr<GraspStatisticsPublisher> GraspStatisticsPublisherPtr;
+
+} // namespace
+
+#endif
@@ -0,0 +1,194 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Span tracing of the grasp pipeline in the Chrome trace event format, viewable in chrome://tracing or
+//         Perfetto. Disabled by default, then a span costs a single branch
+
+#ifndef BLOCK_GRASP_GENERATOR__GRASP_TRACE_
+#define BLOCK_GRASP_GENERATOR__GRASP_TRACE_
+
+// ROS
+#include <ros/ros.h>
+
+// C++
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief One finished span
+ */
+struct TraceEvent
+{
+  const char* name_; // string literal, never copied
+  const char* category_; // same
+  const char* arg_name_; // NULL if the span has no argument
+  long arg_value_;
+  unsigned int thread_;
+  double start_; // microseconds
+  double duration_; // microseconds
+};
+
+/**
+ * \brief Process-wide recorder of spans. Every thread gets its own track, named with setThreadName(), and its own
+ *        ring buffer of its last spans, so that threads do not wait for each other to record. Tracing can stay on
+ *        in the field and the buffers be merged and written when a request was slow
+ */
+class GraspTracer
+{
+public:
+
+  /**
+   * \brief Start recording, keeping the last capacity spans of every thread. Clears what was recorded before
+   */
+  static void enable(std::size_t capacity);
+
+  // Stop recording, keeps what was recorded
+  static void disable();
+
+  static bool isEnabled()
+  {
+    return enabled_;
+  }
+
+  /**
+   * \brief Name the calling thread's track
+   */
+  static void setThreadName(const std::string& name);
+
+  // Add a finished span
+  static void record(const char* name, const char* category, const char* arg_name, long arg_value,
+                     double start, double duration);
+
+  /**
+   * \brief Write the recorded spans of all threads, oldest first, as a Chrome trace event JSON object
+   */
+  static void writeChromeTrace(std::ostream& out);
+
+  /**
+   * \return false if the file can not be written
+   */
+  static bool writeChromeTrace(const std::string& file_name);
+
+  // Forget the recorded spans
+  static void clear();
+
+  // Microseconds on the clock spans are measured with
+  static double now()
+  {
+    return ros::WallTime::now().toSec() * 1e6;
+  }
+
+private:
+
+  // Spans and name of one thread
+  struct ThreadBuffer;
+  typedef boost::shared_ptr<ThreadBuffer> ThreadBufferPtr;
+
+  // The calling thread's buffer, created on first use
+  static ThreadBuffer& getThreadBuffer();
+
+  // Read without a lock on every span, so that a disabled tracer costs a single branch
+  static boost::atomic<bool> enabled_;
+
+  // Guards the list of buffers and the capacity, never held while recording
+  static boost::mutex mutex_;
+  static std::vector<ThreadBufferPtr> buffers_;
+  static std::size_t capacity_; // spans per thread
+  static unsigned int num_threads_; // for the sequential ids of the tracks
+
+  // Shares the buffer with the list, so the spans of a thread that has exited are still written
+  static boost::thread_specific_ptr<ThreadBufferPtr> thread_buffer_;
+};
+
+/**
+ * \brief Records a span from construction to destruction, if the tracer was enabled at construction
+ */
+class ScopedTraceSpan
+{
+public:
+
+  /**
+   * \param name, category - string literals, they are kept by pointer
+   * \param arg_name - optional argument shown with the span, e.g. the candidate id
+   */
+  explicit ScopedTraceSpan(const char* name, const char* category = "grasp", const char* arg_name = NULL,
+                           long arg_value = 0)
+    : name_(name),
+      category_(category),
+      arg_name_(arg_name),
+      arg_value_(arg_value),
+      start_(GraspTracer::isEnabled() ? GraspTracer::now() : -1)
+  {
+  }
+
+  ~ScopedTraceSpan()
+  {
+    if( start_ >= 0 )
+      GraspTracer::record(name_, category_, arg_name_, arg_value_, start_, GraspTracer::now() - start_);
+  }
+
+private:
+
+  const char* name_;
+  const char* category_;
+  const char* arg_name_;
+  long arg_value_;
+  double start_; // <0 when not recording
+};
+
+} // namespace
+
+// Trace the rest of the scope. Define BLOCK_GRASP_GENERATOR_NO_TRACE to compile the spans out entirely
+#ifdef BLOCK_GRASP_GENERATOR_NO_TRACE
+#define GRASP_TRACE_SPAN(name)
+#define GRASP_TRACE_SPAN_ARG(name, arg_name, arg_value)
+#else
+#define GRASP_TRACE_SPAN(name) \
+  block_grasp_generator::ScopedTraceSpan BOOST_PP_CAT(grasp_trace_span_, __LINE__)(name)
+#define GRASP_TRACE_SPAN_ARG(name, arg_name, arg_value) \
+  block_grasp_generator::ScopedTraceSpan BOOST_PP_CAT(grasp_trace_span_, __LINE__)(name, "grasp", arg_name, arg_value)
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Remembers the IK solutions of previously solved end effector poses so that new IK queries can be
+//         seeded with the solution of the closest known pose
+
+#ifndef BLOCK_GRASP_GENERATOR__IK_SEED_DATABASE_
+#define BLOCK_GRASP_GENERATOR__IK_SEED_DATABASE_
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// C++
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief A k-d tree of solved end effector poses per planning group. Safe to query and update from several IK
+ *        threads at once. Poses are compared by position and orientation, where an orientation difference
+ *        of one quaternion unit weighs as much as rotation_weight meters
+ */
+class IkSeedDatabase
+{
+public:
+
+  // Number of values a pose is compared by: position and quaternion
+  static const int KEY_SIZE = 7;
+
+  /**
+   * \brief Constructor
+   * \param rotation_weight - meters that a unit of quaternion distance is worth
+   * \param duplicate_tolerance - a solution closer than this to a known one replaces it instead of growing the tree
+   * \param max_entries - per planning group, solutions beyond this are not remembered
+   */
+  IkSeedDatabase(double rotation_weight = 0.2, double duplicate_tolerance = 0.002, std::size_t max_entries = 100000);
+
+  // Destructor
+  ~IkSeedDatabase();
+
+  /**
+   * \brief Get the solution of the known pose closest to pose
+   * \param seed - resized to the number of joints of the group
+   * \param distance - optional, set to the weighted distance to the known pose
+   * \return false if nothing is known about this planning group
+   */
+  bool findSeed(const std::string& planning_group, const Eigen::Affine3d& pose, std::vector<double>& seed,
+                double* distance = NULL) const;
+
+  /**
+   * \brief Remember the solution of a solved pose
+   * \param solution - num_joints values. Must be the same number of joints for every call of a group
+   * \return false if the number of joints does not match what the group was created with
+   */
+  bool addSolution(const std::string& planning_group, const Eigen::Affine3d& pose, const double* solution,
+                   std::size_t num_joints);
+
+  /**
+   * \brief Number of solutions known for a planning group
+   */
+  std::size_t size(const std::string& planning_group) const;
+
+  /**
+   * \brief Forget everything
+   */
+  void clear();
+
+  /**
+   * \brief Write all planning groups to a text file
+   * \return false if the file could not be written
+   */
+  bool save(const std::string& file_name) const;
+
+  /**
+   * \brief Add the planning groups of a file written by save(), replacing the groups already known by that name.
+   *        The trees are rebuilt balanced
+   * \return false if the file could not be read or is malformed
+   */
+  bool load(const std::string& file_name);
+
+private:
+
+  struct Node
+  {
+    double key_[KEY_SIZE];
+    std::size_t solution_; // offset into Tree::solutions_
+    int left_; // index into Tree::nodes_, -1 if none
+    int right_;
+  };
+
+  struct Tree
+  {
+    Tree() : num_joints_(0), root_(-1), balanced_size_(0) {}
+    std::size_t num_joints_;
+    int root_; // index into nodes_, -1 if empty
+    std::size_t balanced_size_; // number of nodes at the last rebuild
+    std::vector<Node> nodes_;
+    std::vector<double> solutions_; // num_joints_ values per node
+  };
+
+  struct KeyLess;
+
+  // Convert a pose to the values it is compared by
+  void getKey(const Eigen::Affine3d& pose, double* key) const;
+
+  // Squared distance between two keys
+  static double getDistanceSq(const double* a, const double* b);
+
+  // Index of the node closest to key, or -1 if the tree is empty
+  static int findNearest(const Tree& tree, const double* key, double& best_distance_sq);
+
+  // Recursive part of findNearest()
+  static void findNearest(const Tree& tree, int node, int depth, const double* key,
+                          int& best, double& best_distance_sq);
+
+  // Attach a node that is already in tree.nodes_ to the tree
+  static void insertNode(Tree& tree, int node);
+
+  // Recursively link the nodes order[begin, end) into a balanced subtree, returning its root
+  static int buildBalanced(Tree& tree, std::vector<int>& order, std::size_t begin, std::size_t end, int depth);
+
+  // Relink all of a tree's nodes balanced. Online insertion does not rebalance, so this is done whenever
+  // the tree has doubled
+  static void rebuild(Tree& tree);
+
+  typedef std::map<std::string, Tree> TreeMap;
+  TreeMap trees_;
+  mutable boost::shared_mutex mutex_;
+
+  double rotation_weight_;
+  double duplicate_tolerance_;
+  std::size_t max_entries_;
+
+}; // end of class
+
+typedef boost::shared_ptr<IkSeedDatabase> IkSeedDatabasePtr;
+typedef boost::shared_ptr<const IkSeedDatabase> IkSeedDatabaseConstPtr;
+
+} // namespace
+
+#endif
@@ -0,0 +1,195 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Learns how long IK takes per workspace region and end effector orientation, so that every query gets
+//         a timeout that fits how hard its pose is instead of one fixed timeout
+
+#ifndef BLOCK_GRASP_GENERATOR__IK_TIMEOUT_MODEL_
+#define BLOCK_GRASP_GENERATOR__IK_TIMEOUT_MODEL_
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// C++
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/cstdint.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief How IkTimeoutModel turns the solve times of a bin into a timeout
+ */
+struct IkTimeoutSettings
+{
+  IkTimeoutSettings() :
+    cell_size_(0.1),
+    quantile_(0.95),
+    margin_(1.5),
+    min_timeout_(0.005),
+    max_timeout_(0.2),
+    min_samples_(10),
+    max_samples_(64),
+    min_success_rate_(0.02),
+    explore_interval_(50),
+    history_length_(1000)
+  {}
+  double cell_size_; // meters, edge of the cubes the workspace is divided into
+  double quantile_; // of the recent successful solve times of a bin, in (0, 1]
+  double margin_; // the timeout is the quantile times this
+  double min_timeout_; // bounds of every learned timeout
+  double max_timeout_;
+  std::size_t min_samples_; // solve times a bin needs before they are trusted, until then the default timeout is
+                            // used as it is
+  std::size_t max_samples_; // recent successful solve times kept per bin
+  double min_success_rate_; // bins that solve fewer of their queries than this get min_timeout_
+  std::size_t explore_interval_; // every this many queries of a bin get max_timeout_, so the bin can learn that
+                                 // a pose solves slower than its timeout allows. 0 to disable
+  std::size_t history_length_; // the counts of a bin are halved when it has seen this many queries, so that the
+                               // success rate follows changes
+};
+
+/**
+ * \brief Solve times and outcomes of IK queries per planning group, binned by the position of the end effector
+ *        pose in cubes of cell_size_ and its orientation in 24 bins: the nearest of the rotations that map base
+ *        axes to base axes. Safe to query and update from several IK threads at once
+ */
+class IkTimeoutModel
+{
+public:
+
+  // Constructor
+  explicit IkTimeoutModel(const IkTimeoutSettings& settings = IkTimeoutSettings());
+
+  // Destructor
+  ~IkTimeoutModel();
+
+  /**
+   * \brief Timeout for an IK query of pose
+   * \param default_timeout - returned unchanged while the pose's bin knows too little, and the least time an
+   *        exploring query gets
+   */
+  double getTimeout(const std::string& planning_group, const Eigen::Affine3d& pose, double default_timeout) const;
+
+  /**
+   * \brief Remember the outcome of a query
+   * \param solve_time - seconds the solver took
+   * \param solved - false if the solver timed out or found no solution
+   */
+  void addQuery(const std::string& planning_group, const Eigen::Affine3d& pose, double solve_time, bool solved);
+
+  /**
+   * \brief Number of bins that have seen queries of a planning group
+   */
+  std::size_t size(const std::string& planning_group) const;
+
+  /**
+   * \brief Forget everything
+   */
+  void clear();
+
+  /**
+   * \brief Write all planning groups to a text file
+   * \return false if the file could not be written
+   */
+  bool save(const std::string& file_name) const;
+
+  /**
+   * \brief Add the planning groups of a file written by save(), replacing the groups already known by that name
+   * \return false if the file could not be read, is malformed or was written with a different cell size
+   */
+  bool load(const std::string& file_name);
+
+  const IkTimeoutSettings& getSettings() const
+  {
+    return settings_;
+  }
+
+private:
+
+  struct BinKey
+  {
+    int x_;
+    int y_;
+    int z_;
+    int orientation_;
+    bool operator<(const BinKey& other) const;
+  };
+
+  struct Bin
+  {
+    Bin() : queries_(0), solved_(0), next_sample_(0), solve_time_quantile_(0) {}
+    boost::uint64_t queries_;
+    boost::uint64_t solved_;
+    std::vector<double> solve_times_; // of solved queries, a ring of up to max_samples_
+    std::size_t next_sample_; // where the next solve time goes once the ring is full
+    double solve_time_quantile_; // quantile_ of solve_times_, kept up to date so queries only read it
+  };
+
+  typedef std::map<BinKey, Bin> BinMap;
+  typedef std::map<std::string, BinMap> GroupMap;
+
+  // The bin of a pose
+  BinKey getKey(const Eigen::Affine3d& pose) const;
+
+  // The nearest rotation that maps base axes to base axes, as the indices 0-5 (axis and sign) of its x and z axes:
+  // x * 6 + z. 24 of the 36 indices occur
+  static int getOrientationIndex(const Eigen::Matrix3d& rotation);
+
+  // Recompute the quantile of a bin's solve times. Call with the mutex locked exclusively
+  void updateQuantile(Bin& bin);
+
+  // Keep a timeout within the bounds of the settings
+  double clampTimeout(double timeout) const;
+
+  IkTimeoutSettings settings_;
+  GroupMap groups_;
+  std::vector<double> quantile_scratch_; // for updateQuantile(), holds max_samples_ without allocating
+  mutable boost::shared_mutex mutex_;
+
+}; // end of class
+
+typedef boost::shared_ptr<IkTimeoutModel> IkTimeoutModelPtr;
+typedef boost::shared_ptr<const IkTimeoutModel> IkTimeoutModelConstPtr;
+
+} // namespace
+
+#endif
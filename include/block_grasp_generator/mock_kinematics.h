@@ -0,0 +1,175 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Stand-in kinematics solver with a configurable latency distribution, success rate and timeout
+//         behavior, for benchmarking the grasp filter without a robot's MoveIt config
+
+#ifndef BLOCK_GRASP_GENERATOR__MOCK_KINEMATICS_
+#define BLOCK_GRASP_GENERATOR__MOCK_KINEMATICS_
+
+// MoveIt
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <moveit/robot_model/robot_model.h>
+
+// C++
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief What a failing query does
+ */
+enum mock_timeout_t
+{
+  MOCK_FAIL_FAST, // give up after the sampled latency with NO_IK_SOLUTION, like an analytic solver
+  MOCK_USE_TIMEOUT // search until the timeout runs out and report TIMED_OUT, like a numerical solver
+};
+
+/**
+ * \brief How the mock solver behaves
+ */
+struct MockKinematicsSettings
+{
+  MockKinematicsSettings() :
+    latency_median_(0.002),
+    latency_sigma_(0.5),
+    success_rate_(0.5),
+    timeout_behavior_(MOCK_USE_TIMEOUT),
+    busy_wait_(true),
+    seed_(0)
+  {}
+  double latency_median_; // seconds, successful queries take a log-normally distributed time
+  double latency_sigma_; // of the log of the latency, 0 for a constant latency
+  double success_rate_; // fraction of the poses that have a solution
+  mock_timeout_t timeout_behavior_;
+  bool busy_wait_; // burn cpu like a real solver instead of sleeping
+  unsigned int seed_; // of the latency samples and of which poses are solvable
+};
+
+/**
+ * \brief Solves a pose if a hash of the pose says so, so every solver instance and every seed agrees on which
+ *        candidates are feasible and repeated runs return the same result. Latencies are sampled per query.
+ *        Solutions are all zero
+ */
+class MockKinematics : public kinematics::KinematicsBase
+{
+public:
+
+  /**
+   * \brief Constructor
+   * \param instance - offsets the seed of the latency samples, so that several solvers do not run in lockstep
+   */
+  MockKinematics(const MockKinematicsSettings& settings, const robot_model::JointModelGroup* joint_model_group,
+                 unsigned int instance = 0);
+
+  /**
+   * \brief Allocator for GraspFilter::setSolverAllocator() that creates a mock solver per thread and tier
+   */
+  static robot_model::SolverAllocatorFn getAllocator(const MockKinematicsSettings& settings);
+
+  /**
+   * \brief Whether the mock has a solution for a pose
+   */
+  bool isSolvable(const geometry_msgs::Pose& ik_pose) const;
+
+  virtual bool getPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+                             std::vector<double>& solution, moveit_msgs::MoveItErrorCodes& error_code,
+                             const kinematics::KinematicsQueryOptions& options =
+                             kinematics::KinematicsQueryOptions()) const;
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+                                double timeout, std::vector<double>& solution,
+                                moveit_msgs::MoveItErrorCodes& error_code,
+                                const kinematics::KinematicsQueryOptions& options =
+                                kinematics::KinematicsQueryOptions()) const;
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+                                double timeout, const std::vector<double>& consistency_limits,
+                                std::vector<double>& solution, moveit_msgs::MoveItErrorCodes& error_code,
+                                const kinematics::KinematicsQueryOptions& options =
+                                kinematics::KinematicsQueryOptions()) const;
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+                                double timeout, std::vector<double>& solution,
+                                const IKCallbackFn& solution_callback, moveit_msgs::MoveItErrorCodes& error_code,
+                                const kinematics::KinematicsQueryOptions& options =
+                                kinematics::KinematicsQueryOptions()) const;
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+                                double timeout, const std::vector<double>& consistency_limits,
+                                std::vector<double>& solution, const IKCallbackFn& solution_callback,
+                                moveit_msgs::MoveItErrorCodes& error_code,
+                                const kinematics::KinematicsQueryOptions& options =
+                                kinematics::KinematicsQueryOptions()) const;
+
+  // Not supported, returns false
+  virtual bool getPositionFK(const std::vector<std::string>& link_names, const std::vector<double>& joint_angles,
+                             std::vector<geometry_msgs::Pose>& poses) const;
+
+  virtual bool initialize(const std::string& robot_description, const std::string& group_name,
+                          const std::string& base_frame, const std::string& tip_frame, double search_discretization);
+
+  virtual const std::vector<std::string>& getJointNames() const
+  {
+    return joint_names_;
+  }
+
+  virtual const std::vector<std::string>& getLinkNames() const
+  {
+    return link_names_;
+  }
+
+private:
+
+  // Sample a latency and spend it, up to timeout
+  bool spend(double timeout, bool solvable) const;
+
+  MockKinematicsSettings settings_;
+  std::vector<std::string> joint_names_;
+  std::vector<std::string> link_names_;
+
+  // every thread has its own solver, the lock is only there because the queries are const
+  mutable boost::random::mt19937 rng_;
+  mutable boost::mutex rng_mutex_;
+
+}; // end of class
+
+typedef boost::shared_ptr<MockKinematics> MockKinematicsPtr;
+
+} // namespace
+
+#endif
@@ -0,0 +1,225 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Evaluates the grasps of a block for several arms at once and recommends the arm to pick with
+
+#ifndef BLOCK_GRASP_GENERATOR__MULTI_ARM_EVALUATOR_
+#define BLOCK_GRASP_GENERATOR__MULTI_ARM_EVALUATOR_
+
+// Grasp generation and filtering
+#include <block_grasp_generator/block_grasp_generator.h>
+#include <block_grasp_generator/grasp_filter.h>
+#include <block_grasp_generator/arm_symmetry.h>
+
+// C++
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief When MultiArmGraspEvaluator stops early and which grasps count
+ */
+struct MultiArmSettings
+{
+  MultiArmSettings() :
+    enough_grasps_(0),
+    min_quality_(0)
+  {}
+  std::size_t enough_grasps_; // stop all arms once one has this many good grasps, 0 to evaluate every arm fully
+  double min_quality_; // grasps scoring at least this are good, see GraspGeneratorCore::scoreGrasp()
+};
+
+// Receives the feasible grasps of an arm as they are found
+typedef boost::function<void(std::size_t arm, const GraspCandidate& candidate, const double* solution)>
+  ArmGraspCallback;
+
+// Class
+class MultiArmGraspEvaluator
+{
+public:
+
+  // Constructor
+  explicit MultiArmGraspEvaluator(const MultiArmSettings& settings = MultiArmSettings());
+
+  // Destructor
+  ~MultiArmGraspEvaluator();
+
+  /**
+   * \brief Add an arm. Every arm needs a filter of its own, so that every arm has its own solver pool
+   * \param name - e.g. "right"
+   * \param grasp_data - the arm's end effector and sweep settings
+   * \param filter - for the arm's planning group
+   * \return index of the arm
+   */
+  std::size_t addArm(const std::string& name, const RobotGraspData& grasp_data, GraspFilterPtr filter);
+
+  /**
+   * \brief Evaluate two arms of a mirror-symmetric robot together on one thread: the first arm is solved in full and
+   *        its solutions seed the other one, see GraspFilter::filterMirroredGrasps(). Both arms get the prefilters
+   *        of their grasp data but no adaptive sampling. The first arm's filter needs a seed database
+   * \param arm - solved in full
+   * \param mirrored_arm - checked from the mirrored solutions of arm first
+   * \param symmetry - maps arm to mirrored_arm
+   * \return false if the arms are the same or one of them is already paired
+   */
+  bool setArmSymmetry(std::size_t arm, std::size_t mirrored_arm, const ArmSymmetry& symmetry);
+
+  /**
+   * \brief Generate and filter the grasps of a block for all arms at once, every arm on its own thread with its own
+   *        filter. Blocks until every arm is done or one has enough_grasps_ good grasps. Arms are streamed, see
+   *        GraspFilter::streamGrasps(), unless their grasp data asks for ordering by the arm base, symmetry
+   *        deduplication or adaptive sampling, see GraspFilter::canStream(). Those arms generate and prefilter all
+   *        candidates first, refine them with GraspFilter::filterGraspsAdaptive() if max_angle_resolution_ is set,
+   *        and pass on their feasible grasps once the filter is done. Arms paired by setArmSymmetry() share a thread
+   * \param block_pose - the block to grasp
+   * \param request_id - for the ids of the candidates, the same for every arm
+   * \param callback - receives every feasible grasp with its arm, one call at a time, may be empty
+   * \return index of the recommended arm: the one that reached enough_grasps_, otherwise the one with the most
+   *         good grasps, ties going to the best grasp. -1 if no arm can grasp the block
+   */
+  int evaluate(const Eigen::Affine3d& block_pose, uint32_t request_id, const ArmGraspCallback& callback);
+
+  std::size_t getNumArms() const
+  {
+    return arms_.size();
+  }
+
+  const std::string& getArmName(std::size_t arm) const
+  {
+    return arms_[arm]->name_;
+  }
+
+  const RobotGraspData& getGraspData(std::size_t arm) const
+  {
+    return arms_[arm]->grasp_data_;
+  }
+
+  GraspFilterPtr getFilter(std::size_t arm) const
+  {
+    return arms_[arm]->filter_;
+  }
+
+  /**
+   * \brief The feasible grasps of an arm and their solutions, from the last evaluate()
+   */
+  const GraspArena& getArena(std::size_t arm) const
+  {
+    return arms_[arm]->arena_;
+  }
+
+  /**
+   * \brief Feasible grasps of an arm that scored at least min_quality_, from the last evaluate()
+   */
+  std::size_t getNumGoodGrasps(std::size_t arm) const
+  {
+    return arms_[arm]->num_good_grasps_;
+  }
+
+  /**
+   * \brief Whether the last evaluate() stopped because an arm had enough grasps
+   */
+  bool wasStoppedEarly() const
+  {
+    return enough_arm_ >= 0;
+  }
+
+  void setSettings(const MultiArmSettings& settings)
+  {
+    settings_ = settings;
+  }
+
+  const MultiArmSettings& getSettings() const
+  {
+    return settings_;
+  }
+
+private:
+
+  struct Arm
+  {
+    std::string name_;
+    RobotGraspData grasp_data_;
+    GraspFilterPtr filter_;
+    GraspArena arena_;
+    std::size_t num_good_grasps_;
+    double best_quality_; // of the feasible grasps, -1 if none
+    bool succeeded_;
+    int mirrored_arm_; // evaluated from this arm's solutions on this arm's thread, -1 for none
+    bool is_mirrored_; // evaluated on the thread of the arm it mirrors
+    ArmSymmetry symmetry_; // maps this arm to mirrored_arm_
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+  typedef boost::shared_ptr<Arm> ArmPtr;
+
+  // Body of an arm's thread
+  void evaluateArm(std::size_t arm, const Eigen::Affine3d& block_pose, uint32_t request_id,
+                   const ArmGraspCallback& callback);
+
+  // Generate with the prefilters, then filter all candidates at once, adaptively if asked, and pass on the
+  // feasible ones
+  bool filterArm(std::size_t arm, const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+                 uint32_t request_id, const ArmGraspCallback& callback);
+
+  // Filter an arm in full and its mirrored arm from its solutions, then pass on the feasible grasps of both
+  bool filterMirroredArms(std::size_t arm, const Eigen::Affine3d& block_pose, uint32_t request_id,
+                          const ArmGraspCallback& callback);
+
+  // Pass on the feasible grasps of an arm that was filtered in batch
+  void deliverGrasps(std::size_t arm, const ArmGraspCallback& callback);
+
+  // Count a feasible grasp, stop all arms once one has enough and pass the grasp on
+  void feasibleGraspCB(std::size_t arm, const ArmGraspCallback& callback, const GraspCandidate& candidate,
+                       const double* solution);
+
+  MultiArmSettings settings_;
+  std::vector<ArmPtr> arms_;
+
+  // serializes the callbacks and guards the counts while evaluating
+  boost::mutex mutex_;
+  int enough_arm_; // the arm that had enough grasps first in the last request, -1 if none
+
+}; // end of class
+
+typedef boost::shared_ptr<MultiArmGraspEvaluator> MultiArmGraspEvaluatorPtr;
+
+} // namespace
+
+#endif
@@ -0,0 +1,130 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman
+   Desc:   Helpers of the benchmarks and the tests
+*/
+
+#include "benchmark_utils.h"
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <urdf_parser/urdf_parser.h>
+#include <srdfdom/model.h>
+
+// C++
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+// Heap allocations of the whole process
+static unsigned long num_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+  __sync_fetch_and_add(&num_allocations, 1);
+  void* ptr = std::malloc(size ? size : 1);
+  if( !ptr )
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* ptr) throw()
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+  std::free(ptr);
+}
+
+namespace block_grasp_generator
+{
+
+// A chain of revolute joints from the base link to a tool link
+robot_model::RobotModelConstPtr loadChainRobotModel(const std::string& base_link,
+  const std::string& planning_group, std::size_t num_joints)
+{
+  std::stringstream urdf;
+  urdf << "<robot name=\"benchmark_arm\">" << "<link name=\"" << base_link << "\"/>";
+  std::string parent = base_link;
+  for (std::size_t i = 0; i < num_joints; ++i)
+  {
+    std::stringstream link;
+    link << "link_" << i;
+    urdf << "<link name=\"" << link.str() << "\"/>"
+         << "<joint name=\"joint_" << i << "\" type=\"revolute\">"
+         << "<parent link=\"" << parent << "\"/><child link=\"" << link.str() << "\"/>"
+         << "<origin xyz=\"0 0 0.1\"/><axis xyz=\"" << ( i % 2 ? "0 1 0" : "0 0 1" ) << "\"/>"
+         << "<limit lower=\"-3.0\" upper=\"3.0\" effort=\"10\" velocity=\"1\"/>"
+         << "</joint>";
+    parent = link.str();
+  }
+  urdf << "</robot>";
+
+  std::stringstream srdf;
+  srdf << "<robot name=\"benchmark_arm\"><group name=\"" << planning_group << "\">"
+       << "<chain base_link=\"" << base_link << "\" tip_link=\"" << parent << "\"/></group></robot>";
+
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(urdf.str());
+  if( !urdf_model )
+  {
+    ROS_ERROR_STREAM_NAMED("benchmark","Unable to parse the benchmark arm's URDF");
+    return robot_model::RobotModelConstPtr();
+  }
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  if( !srdf_model->initString(*urdf_model, srdf.str()) )
+  {
+    ROS_ERROR_STREAM_NAMED("benchmark","Unable to parse the benchmark arm's SRDF");
+    return robot_model::RobotModelConstPtr();
+  }
+
+  return robot_model::RobotModelConstPtr(new robot_model::RobotModel(urdf_model, srdf_model));
+}
+
+// Heap allocations of the whole process so far
+unsigned long getNumAllocations()
+{
+  return __sync_fetch_and_add(&num_allocations, 0);
+}
+
+} // namespace
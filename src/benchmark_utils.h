@@ -0,0 +1,67 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Shared by the benchmarks and the tests: a synthetic arm that needs no robot's MoveIt config, and a
+//         count of the process's heap allocations. Only link benchmark_utils.cpp into executables, it replaces
+//         the global operator new
+
+#ifndef BLOCK_GRASP_GENERATOR__BENCHMARK_UTILS_
+#define BLOCK_GRASP_GENERATOR__BENCHMARK_UTILS_
+
+// MoveIt
+#include <moveit/robot_model/robot_model.h>
+
+// C++
+#include <string>
+#include <cstddef>
+
+namespace block_grasp_generator
+{
+
+/**
+ * \brief A chain of revolute joints from the base link to a tool link, in a single planning group
+ * \return NULL if the generated URDF or SRDF does not parse
+ */
+robot_model::RobotModelConstPtr loadChainRobotModel(const std::string& base_link,
+                                                     const std::string& planning_group, std::size_t num_joints);
+
+/**
+ * \brief Heap allocations of the whole process so far, from every thread
+ */
+unsigned long getNumAllocations();
+
+} // namespace
+
+#endif
@@ -40,227 +40,252 @@ namespace block_grasp_generator
 // Constructor
 BlockGraspGenerator::BlockGraspGenerator(moveit_visual_tools::VisualToolsPtr rviz_tools) :
   visual_tools_(rviz_tools),
-  animate_(false)
+  animate_(false),
+  next_request_id_(0),
+  statistics_(new GraspStatistics())
 {
 }
 
 // Deconstructor
 BlockGraspGenerator::~BlockGraspGenerator()
 {
+  // Finish the queued requests while we still exist
+  executor_.reset();
+}
+
+// Non-blocking generateGrasps()
+boost::shared_future<GraspArenaPtr> BlockGraspGenerator::generateGraspsAsync(const geometry_msgs::Pose& block_pose,
+  const RobotGraspData& grasp_data, GraspArenaPtr arena)
+{
+  if( !arena )
+    arena.reset(new GraspArena());
+
+  return getExecutor()->submit<GraspArenaPtr>(
+    boost::bind(&BlockGraspGenerator::generateGraspsTask, this, block_pose, grasp_data, arena));
+}
+
+// Body of generateGraspsAsync()
+GraspArenaPtr BlockGraspGenerator::generateGraspsTask(geometry_msgs::Pose block_pose, RobotGraspData grasp_data,
+  GraspArenaPtr arena)
+{
+  arena->reset();
+  if( !generateGrasps(block_pose, grasp_data, arena->getCandidates()) )
+    arena->getCandidates().clear();
+  return arena;
+}
+
+// The thread asynchronous requests run on
+GraspExecutorPtr BlockGraspGenerator::getExecutor()
+{
+  if( !executor_ )
+    executor_.reset(new GraspExecutor());
+  return executor_;
 }
 
 // Create all possible grasp positions for a block
 bool BlockGraspGenerator::generateGrasps(const geometry_msgs::Pose& block_pose, const RobotGraspData& grasp_data,
   std::vector<moveit_msgs::Grasp>& possible_grasps)
 {
-  // ---------------------------------------------------------------------------------------------
-  // Create a transform from the block's frame (center of block) to /base_link
-  tf::poseMsgToEigen(block_pose, block_global_transform_);
+  GRASP_TRACE_SPAN("generateGrasps");
 
-  // ---------------------------------------------------------------------------------------------
-  // Calculate grasps in two axis in both directions
-  generateAxisGrasps( possible_grasps, X_AXIS, DOWN, grasp_data); // got no grasps with this alone
-  generateAxisGrasps( possible_grasps, X_AXIS, UP,   grasp_data); // gives some grasps... looks ugly
-  generateAxisGrasps( possible_grasps, Y_AXIS, DOWN, grasp_data); // GOOD ONES!
-  generateAxisGrasps( possible_grasps, Y_AXIS, UP,   grasp_data); // gave a grasp from top... bad
-  ROS_INFO_STREAM_NAMED("grasp", "Generated " << possible_grasps.size() << " grasps." );
+  GraspCandidates candidates;
+  if( !generateGrasps(block_pose, grasp_data, candidates) )
+    return false;
+
+  // Convert to manipulation messages
+  ros::WallTime start_time = ros::WallTime::now();
+  {
+    GRASP_TRACE_SPAN("convert");
+    convertGrasps(candidates, grasp_data, possible_grasps);
+  }
+  statistics_->recordStage(STAGE_CONVERT, (ros::WallTime::now() - start_time).toSec());
+  GRASP_LOG_DEBUG_STREAM("grasp", "Generated " << possible_grasps.size() << " grasps." );
 
   // Visualize results
-  visualizeGrasps(possible_grasps, block_pose, grasp_data);
+  start_time = ros::WallTime::now();
+  {
+    GRASP_TRACE_SPAN("visualize");
+    visualizeGrasps(possible_grasps, block_pose, grasp_data);
+  }
+  statistics_->recordStage(STAGE_VISUALIZE, (ros::WallTime::now() - start_time).toSec());
 
   return true;
 }
 
-// Create grasp positions in one axis
-bool BlockGraspGenerator::generateAxisGrasps(std::vector<moveit_msgs::Grasp>& possible_grasps, grasp_axis_t axis,
-  grasp_direction_t direction, const RobotGraspData& grasp_data)
+// Create all possible grasp positions for a block, without converting to messages
+bool BlockGraspGenerator::generateGrasps(const geometry_msgs::Pose& block_pose, const RobotGraspData& grasp_data,
+  GraspCandidates& possible_grasps)
 {
+  return generateGrasps(block_pose, grasp_data, possible_grasps, next_request_id_++);
+}
 
+// Create all possible grasp positions for a block, for a given request
+bool BlockGraspGenerator::generateGrasps(const geometry_msgs::Pose& block_pose, const RobotGraspData& grasp_data,
+  GraspCandidates& possible_grasps, uint32_t request_id)
+{
   // ---------------------------------------------------------------------------------------------
-  // Grasp parameters
-
-  // Create re-usable approach motion
-  moveit_msgs::GripperTranslation pre_grasp_approach;
-  pre_grasp_approach.direction.header.stamp = ros::Time::now();
-  pre_grasp_approach.desired_distance = grasp_data.approach_retreat_desired_dist_; // The distance the origin of a robot link needs to travel
-  pre_grasp_approach.min_distance = grasp_data.approach_retreat_min_dist_; // half of the desired? Untested.
-
-  // Create re-usable retreat motion
-  moveit_msgs::GripperTranslation post_grasp_retreat;
-  post_grasp_retreat.direction.header.stamp = ros::Time::now();
-  post_grasp_retreat.desired_distance = grasp_data.approach_retreat_desired_dist_; // The distance the origin of a robot link needs to travel
-  post_grasp_retreat.min_distance = grasp_data.approach_retreat_min_dist_; // half of the desired? Untested.
-
-  // Create re-usable blank pose
-  geometry_msgs::PoseStamped grasp_pose_msg;
-  grasp_pose_msg.header.stamp = ros::Time::now();
-  grasp_pose_msg.header.frame_id = grasp_data.base_link_;
-
-  // ---------------------------------------------------------------------------------------------
-  // Angle calculations
-  double radius = grasp_data.grasp_depth_; //0.12
-  double xb;
-  double yb = 0.0; // stay in the y plane of the block
-  double zb;
-  double theta1 = 0.0; // Where the point is located around the block
-  double theta2 = 0.0; // UP 'direction'
-
-  // Gripper direction (UP/DOWN) rotation. UP set by default
-  if( direction == DOWN )
-  {
-    theta2 = M_PI;
-  }
+  // Create a transform from the block's frame (center of block) to /base_link
+  Eigen::Affine3d block_global_transform;
+  tf::poseMsgToEigen(block_pose, block_global_transform);
 
   // ---------------------------------------------------------------------------------------------
-  // ---------------------------------------------------------------------------------------------
-  // Begin Grasp Generator Loop
-  // ---------------------------------------------------------------------------------------------
-  // ---------------------------------------------------------------------------------------------
+  // Calculate grasps in two axis in both directions
+  GraspGeometry geometry;
+  getGraspGeometry(grasp_data, geometry);
 
-  /* Developer Note:
-   * Create angles 180 degrees around the chosen axis at given resolution
-   * We create the grasps in the reference frame of the block, then later convert it to the base link
-   */
-  for(int i = 0; i <= grasp_data.angle_resolution_; ++i)
+  ros::WallTime start_time = ros::WallTime::now();
+  std::size_t first_new = possible_grasps.size();
   {
-    // Create a Grasp message
-    moveit_msgs::Grasp new_grasp;
-
-    // Calculate grasp pose
-    xb = radius*cos(theta1);
-    zb = radius*sin(theta1);
-
-    Eigen::Affine3d grasp_pose;
-
-    switch(axis)
+    GRASP_TRACE_SPAN_ARG("generate", "angle_resolution", geometry.angle_resolution_);
+    possible_grasps.reserve(first_new + GraspGeneratorCore::getNumGrasps(geometry));
+    if( !generator_core_.generateGrasps(block_global_transform, geometry, request_id, possible_grasps) )
     {
-    case X_AXIS:
-      grasp_pose = Eigen::AngleAxisd(theta1, Eigen::Vector3d::UnitX())
-        * Eigen::AngleAxisd(-0.5*M_PI, Eigen::Vector3d::UnitZ())
-        * Eigen::AngleAxisd(theta2, Eigen::Vector3d::UnitX()); // Flip 'direction'
-
-      grasp_pose.translation() = Eigen::Vector3d( yb, xb ,zb);
-
-      break;
-    case Y_AXIS:
-      grasp_pose =
-        Eigen::AngleAxisd(M_PI - theta1, Eigen::Vector3d::UnitY())
-        *Eigen::AngleAxisd(theta2, Eigen::Vector3d::UnitX()); // Flip 'direction'
-
-      grasp_pose.translation() = Eigen::Vector3d( xb, yb ,zb);
-
-      break;
-    case Z_AXIS:
-      ROS_ERROR_STREAM_NAMED("grasp","Z Axis not implemented!");
+      ROS_ERROR_STREAM_NAMED("grasp","Angle resolution " << geometry.angle_resolution_ << " is not in [1, "
+                             << GraspId::MAX_ANGLE_RESOLUTION << "]");
       return false;
-
-      break;
     }
+  }
 
-    /* The estimated probability of success for this grasp, or some other measure of how "good" it is.
-     * Here we base bias the score based on how far the wrist is from the surface, preferring a greater
-     * distance to prevent wrist/end effector collision with the table
-     */
-    double score = sin(theta1);
-    new_grasp.grasp_quality = std::max(score,0.1); // don't allow score to drop below 0.1 b/c all grasps are ok
-
-    // Calculate the theta1 for next time
-    theta1 += M_PI / grasp_data.angle_resolution_;
-
-    // A name for this grasp
-    static int grasp_id = 0;
-    new_grasp.id = "Grasp" + boost::lexical_cast<std::string>(grasp_id);
-    ++grasp_id;
-
-    // PreGrasp and Grasp Postures --------------------------------------------------------------------------
-
-    // The internal posture of the hand for the pre-grasp only positions are used
-    new_grasp.pre_grasp_posture = grasp_data.pre_grasp_posture_;
-
-    // The internal posture of the hand for the grasp positions and efforts are used
-    new_grasp.grasp_posture = grasp_data.grasp_posture_;
-
-    // Grasp ------------------------------------------------------------------------------------------------
-
+  ros::WallTime prefilter_time = ros::WallTime::now();
+  statistics_->recordStage(STAGE_GENERATE, (prefilter_time - start_time).toSec());
+  {
+    GRASP_TRACE_SPAN("prefilter");
+
+    // Try the wrist orientations facing back toward the robot first
+    std::size_t num_facing_away = generator_core_.orderByArmBase(block_global_transform, geometry, first_new,
+                                                                 possible_grasps);
+    if( num_facing_away > 0 )
+      GRASP_LOG_DEBUG_STREAM("grasp","Dropped " << num_facing_away << " grasps facing away from the arm base");
+
+    // Drop the candidates that are equivalent because of the block's and the gripper's symmetry
+    GraspCandidates symmetric_variants;
+    std::size_t num_symmetric = generator_core_.removeSymmetricGrasps(block_global_transform, geometry, first_new,
+                                                                      possible_grasps, symmetric_variants);
+    {
+      boost::mutex::scoped_lock slock(symmetric_variants_mutex_);
+      symmetric_variants_.swap(symmetric_variants);
+    }
+    if( num_symmetric > 0 )
+      GRASP_LOG_DEBUG_STREAM("grasp","Dropped " << num_symmetric << " symmetric grasps");
 
-    // DEBUG - show original grasp pose before tranform to gripper frame
-    if( true )
+    // Skip the slots that have almost never been feasible for blocks around here
+    if( slot_history_ )
     {
-      tf::poseEigenToMsg(block_global_transform_ * grasp_pose, grasp_pose_msg.pose);
-      visual_tools_->publishArrow(grasp_pose_msg.pose, moveit_visual_tools::GREEN);
+      std::size_t num_pruned = slot_history_->pruneGrasps(block_global_transform, first_new, possible_grasps);
+      if( num_pruned > 0 )
+        GRASP_LOG_DEBUG_STREAM("grasp","Pruned " << num_pruned << " grasps of rarely feasible slots");
     }
+  }
+  statistics_->recordStage(STAGE_PREFILTER, (ros::WallTime::now() - prefilter_time).toSec());
 
-    // ------------------------------------------------------------------------
-    // Change grasp to frame of reference of this custom end effector
+  // DEBUG - show original grasp pose before tranform to gripper frame
+  if( !visual_tools_->isMuted() )
+  {
+    Eigen::Affine3d eef_to_grasp_pose = geometry.grasp_pose_to_eef_pose_.inverse();
+    geometry_msgs::Pose grasp_pose_msg;
+    for (std::size_t i = first_new; i < possible_grasps.size(); ++i)
+    {
+      if( possible_grasps[i].approach_ != APPROACH_BASE_FRAME )
+        continue;
+      tf::poseEigenToMsg(possible_grasps[i].grasp_pose_ * eef_to_grasp_pose, grasp_pose_msg);
+      visual_tools_->publishArrow(grasp_pose_msg, moveit_visual_tools::GREEN);
+    }
+  }
 
-    // Convert to Eigen
-    Eigen::Affine3d eef_conversion_pose;
-    tf::poseMsgToEigen(grasp_data.grasp_pose_to_eef_pose_, eef_conversion_pose);
+  return true;
+}
 
-    // Transform the grasp pose
-    grasp_pose = grasp_pose * eef_conversion_pose;
+// Convert core grasp candidates to full manipulation messages
+void BlockGraspGenerator::convertGrasps(const GraspCandidates& candidates, const RobotGraspData& grasp_data,
+  std::vector<moveit_msgs::Grasp>& possible_grasps)
+{
+  possible_grasps.resize(possible_grasps.size() + candidates.size());
+  std::vector<moveit_msgs::Grasp>::iterator grasp_it = possible_grasps.end() - candidates.size();
+  for (std::size_t i = 0; i < candidates.size(); ++i, ++grasp_it)
+    convertGrasp(candidates[i], grasp_data, *grasp_it);
+}
 
-    // ------------------------------------------------------------------------
-    // Convert pose to global frame (base_link)
-    tf::poseEigenToMsg(block_global_transform_ * grasp_pose, grasp_pose_msg.pose);
+// Extract the settings the ROS-independent core needs
+void BlockGraspGenerator::getGraspGeometry(const RobotGraspData& grasp_data, GraspGeometry& geometry)
+{
+  tf::poseMsgToEigen(grasp_data.grasp_pose_to_eef_pose_, geometry.grasp_pose_to_eef_pose_);
+  geometry.grasp_depth_ = grasp_data.grasp_depth_;
+  geometry.angle_resolution_ = grasp_data.angle_resolution_;
+  geometry.max_angle_resolution_ = grasp_data.max_angle_resolution_;
+  geometry.refine_quality_threshold_ = grasp_data.refine_quality_threshold_;
+  geometry.block_symmetry_order_ = grasp_data.block_symmetry_order_;
+  geometry.gripper_symmetry_order_ = grasp_data.gripper_symmetry_order_;
+  geometry.symmetry_position_tolerance_ = grasp_data.symmetry_position_tolerance_;
+  geometry.symmetry_angle_tolerance_ = grasp_data.symmetry_angle_tolerance_;
+  geometry.face_arm_base_ = grasp_data.face_arm_base_;
+  tf::pointMsgToEigen(grasp_data.arm_base_position_, geometry.arm_base_position_);
+  geometry.min_arm_base_alignment_ = grasp_data.min_arm_base_alignment_;
+}
 
-    // The position of the end-effector for the grasp relative to a reference frame (that is always specified elsewhere, not in this message)
-    new_grasp.grasp_pose = grasp_pose_msg;
+// Convert a core grasp candidate to a full manipulation message
+void BlockGraspGenerator::convertGrasp(const GraspCandidate& candidate, const RobotGraspData& grasp_data,
+  moveit_msgs::Grasp& new_grasp)
+{
+  // A name for this grasp
+  new_grasp.id = candidate.id_.toString();
 
-    // Other ------------------------------------------------------------------------------------------------
+  new_grasp.grasp_quality = candidate.grasp_quality_;
 
-    // the maximum contact force to use while grasping (<=0 to disable)
-    new_grasp.max_contact_force = 0;
+  // PreGrasp and Grasp Postures --------------------------------------------------------------------------
 
-    // -------------------------------------------------------------------------------------------------------
-    // -------------------------------------------------------------------------------------------------------
-    // Approach and retreat
-    // -------------------------------------------------------------------------------------------------------
-    // -------------------------------------------------------------------------------------------------------
+  // The internal posture of the hand for the pre-grasp only positions are used
+  new_grasp.pre_grasp_posture = grasp_data.pre_grasp_posture_;
 
-    // Straight down ---------------------------------------------------------------------------------------
-    // With respect to the base link/world frame
+  // The internal posture of the hand for the grasp positions and efforts are used
+  new_grasp.grasp_posture = grasp_data.grasp_posture_;
 
-    // Approach
-    pre_grasp_approach.direction.header.frame_id = grasp_data.base_link_;
-    pre_grasp_approach.direction.vector.x = 0;
-    pre_grasp_approach.direction.vector.y = 0;
-    pre_grasp_approach.direction.vector.z = -1; // Approach direction (negative z axis)  // TODO: document this assumption
-    new_grasp.pre_grasp_approach = pre_grasp_approach;
+  // Grasp ------------------------------------------------------------------------------------------------
 
-    // Retreat
-    post_grasp_retreat.direction.header.frame_id = grasp_data.base_link_;
-    post_grasp_retreat.direction.vector.x = 0;
-    post_grasp_retreat.direction.vector.y = 0;
-    post_grasp_retreat.direction.vector.z = 1; // Retreat direction (pos z axis)
-    new_grasp.post_grasp_retreat = post_grasp_retreat;
+  // The position of the end-effector for the grasp relative to a reference frame (that is always specified elsewhere, not in this message)
+  new_grasp.grasp_pose.header.stamp = ros::Time::now();
+  new_grasp.grasp_pose.header.frame_id = grasp_data.base_link_;
+  tf::poseEigenToMsg(candidate.grasp_pose_, new_grasp.grasp_pose.pose);
 
-    // Add to vector
-    possible_grasps.push_back(new_grasp);
+  // Other ------------------------------------------------------------------------------------------------
 
-    // Angled with pose -------------------------------------------------------------------------------------
-    // Approach with respect to end effector orientation
+  // the maximum contact force to use while grasping (<=0 to disable)
+  new_grasp.max_contact_force = 0;
 
-    // Approach
-    pre_grasp_approach.direction.header.frame_id = grasp_data.ee_parent_link_;
-    pre_grasp_approach.direction.vector.x = 0;
-    pre_grasp_approach.direction.vector.y = 0;
-    pre_grasp_approach.direction.vector.z = 1;
-    new_grasp.pre_grasp_approach = pre_grasp_approach;
+  // -------------------------------------------------------------------------------------------------------
+  // Approach and retreat
+  // -------------------------------------------------------------------------------------------------------
+  new_grasp.pre_grasp_approach.direction.header.stamp = new_grasp.grasp_pose.header.stamp;
+  new_grasp.pre_grasp_approach.desired_distance = grasp_data.approach_retreat_desired_dist_; // The distance the origin of a robot link needs to travel
+  new_grasp.pre_grasp_approach.min_distance = grasp_data.approach_retreat_min_dist_; // half of the desired? Untested.
 
-    // Retreat
-    post_grasp_retreat.direction.header.frame_id = grasp_data.ee_parent_link_;
-    post_grasp_retreat.direction.vector.x = 0;
-    post_grasp_retreat.direction.vector.y = 0;
-    post_grasp_retreat.direction.vector.z = -1;
-    new_grasp.post_grasp_retreat = post_grasp_retreat;
+  new_grasp.post_grasp_retreat.direction.header.stamp = new_grasp.grasp_pose.header.stamp;
+  new_grasp.post_grasp_retreat.desired_distance = grasp_data.approach_retreat_desired_dist_; // The distance the origin of a robot link needs to travel
+  new_grasp.post_grasp_retreat.min_distance = grasp_data.approach_retreat_min_dist_; // half of the desired? Untested.
 
-    // Add to vector
-    possible_grasps.push_back(new_grasp);
+  new_grasp.pre_grasp_approach.direction.vector.x = 0;
+  new_grasp.pre_grasp_approach.direction.vector.y = 0;
+  new_grasp.post_grasp_retreat.direction.vector.x = 0;
+  new_grasp.post_grasp_retreat.direction.vector.y = 0;
 
+  switch(candidate.approach_)
+  {
+    case APPROACH_BASE_FRAME:
+      // Straight down ---------------------------------------------------------------------------------------
+      // With respect to the base link/world frame
+      new_grasp.pre_grasp_approach.direction.header.frame_id = grasp_data.base_link_;
+      new_grasp.pre_grasp_approach.direction.vector.z = -1; // Approach direction (negative z axis)  // TODO: document this assumption
+      new_grasp.post_grasp_retreat.direction.header.frame_id = grasp_data.base_link_;
+      new_grasp.post_grasp_retreat.direction.vector.z = 1; // Retreat direction (pos z axis)
+      break;
+    case APPROACH_EEF_FRAME:
+      // Angled with pose -------------------------------------------------------------------------------------
+      // Approach with respect to end effector orientation
+      new_grasp.pre_grasp_approach.direction.header.frame_id = grasp_data.ee_parent_link_;
+      new_grasp.pre_grasp_approach.direction.vector.z = 1;
+      new_grasp.post_grasp_retreat.direction.header.frame_id = grasp_data.ee_parent_link_;
+      new_grasp.post_grasp_retreat.direction.vector.z = -1;
+      break;
   }
-
-  return true;
 }
 
 // Show all grasps in Rviz
@@ -269,17 +294,17 @@ void BlockGraspGenerator::visualizeGrasps(const std::vector<moveit_msgs::Grasp>&
 {
   if(visual_tools_->isMuted())
   {
-    ROS_DEBUG_STREAM_NAMED("grasp","Not visualizing grasps - muted.");
+    GRASP_LOG_DEBUG_STREAM("grasp","Not visualizing grasps - muted.");
     return;
   }
 
   if( !animate_ )
   {
-    ROS_DEBUG_STREAM_NAMED("grasp","Not visualizing grasps - animation set to false.");
+    GRASP_LOG_DEBUG_STREAM("grasp","Not visualizing grasps - animation set to false.");
     return;
   }
 
-  ROS_DEBUG_STREAM_NAMED("grasp","Visualizing " << possible_grasps.size() << " grasps");
+  GRASP_LOG_DEBUG_STREAM("grasp","Visualizing " << possible_grasps.size() << " grasps");
 
   int i = 0;
   for(std::vector<moveit_msgs::Grasp>::const_iterator grasp_it = possible_grasps.begin();
@@ -0,0 +1,375 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman
+   Desc:   Benchmarks the grasp generator without a robot, rviz or sleeps. Every stage runs on the same seeded
+           workload of block poses spread over the table, once per angle resolution, and reports nanoseconds
+           and heap allocations per grasp as CSV so runs can be compared by scripts:
+
+             rosrun block_grasp_generator block_grasp_generator_benchmark [output.csv]
+*/
+
+// ROS
+#include <ros/ros.h>
+
+// Grasp generation
+#include <block_grasp_generator/block_grasp_generator.h>
+#include <block_grasp_generator/grasp_generator_core.h>
+#include "benchmark_utils.h"
+
+// Baxter specific properties
+#include <block_grasp_generator/baxter_data.h>
+#include <block_grasp_generator/custom_environment2.h>
+
+// C++
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <fstream>
+#include <iostream>
+
+namespace baxter_pick_place
+{
+
+static const unsigned int WORKLOAD_SEED = 42;
+static const std::size_t NUM_BLOCKS = 64;
+static const std::size_t NUM_REPEATS = 20; // of each block, to get above the timer's resolution
+static const int ANGLE_RESOLUTIONS[] = { 8, 16, 32, 64 };
+
+/**
+ * \brief Time and allocations of one stage at one angle resolution
+ */
+struct StageResult
+{
+  std::string stage_;
+  int angle_resolution_;
+  std::size_t num_grasps_; // over all blocks and repeats
+  double seconds_;
+  unsigned long num_allocations_; // of the whole process, only the benchmark thread allocates while a stage is timed
+};
+
+class GraspGeneratorBenchmark
+{
+private:
+
+  // Grasp generator, only used for its message conversion and full pipeline
+  block_grasp_generator::BlockGraspGeneratorPtr block_grasp_generator_;
+  block_grasp_generator::GraspGeneratorCore generator_core_;
+
+  // muted, nothing is published
+  moveit_visual_tools::VisualToolsPtr visual_tools_;
+
+  // robot-specific data for generating grasps
+  block_grasp_generator::RobotGraspData grasp_data_;
+
+  // the workload, same on every run
+  std::vector<geometry_msgs::Pose> block_poses_;
+
+  std::vector<StageResult> results_;
+
+  // stage being timed
+  ros::WallTime start_time_;
+  unsigned long start_allocations_;
+
+public:
+
+  // Constructor
+  GraspGeneratorBenchmark()
+  {
+    grasp_data_ = baxter_pick_place::loadRobotGraspData("right", BLOCK_SIZE);
+
+    visual_tools_.reset(new moveit_visual_tools::VisualTools(baxter_pick_place::BASE_LINK));
+    visual_tools_->setMuted(true);
+
+    block_grasp_generator_.reset( new block_grasp_generator::BlockGraspGenerator(visual_tools_) );
+
+    generateBlockPoses();
+  }
+
+  /**
+   * \brief Block poses spread uniformly over the table with a random rotation around z
+   */
+  void generateBlockPoses()
+  {
+    boost::random::mt19937 rng(WORKLOAD_SEED);
+    double x_min, x_max, y_min, y_max;
+    getTableDepthRange(x_min, x_max);
+    getTableWidthRange(y_min, y_max);
+    boost::random::uniform_real_distribution<double> x_dist(x_min, x_max);
+    boost::random::uniform_real_distribution<double> y_dist(y_min, y_max);
+    boost::random::uniform_real_distribution<double> angle_dist(0, M_PI);
+
+    block_poses_.resize(NUM_BLOCKS);
+    for (std::size_t i = 0; i < NUM_BLOCKS; ++i)
+    {
+      block_poses_[i].position.x = x_dist(rng);
+      block_poses_[i].position.y = y_dist(rng);
+      block_poses_[i].position.z = getTableHeight(FLOOR_TO_BASE_HEIGHT);
+
+      Eigen::Quaterniond quat(Eigen::AngleAxis<double>(angle_dist(rng), Eigen::Vector3d::UnitZ()));
+      block_poses_[i].orientation.x = quat.x();
+      block_poses_[i].orientation.y = quat.y();
+      block_poses_[i].orientation.z = quat.z();
+      block_poses_[i].orientation.w = quat.w();
+    }
+  }
+
+  /**
+   * \brief Run every stage at every angle resolution
+   */
+  void run()
+  {
+    for (std::size_t i = 0; i < sizeof(ANGLE_RESOLUTIONS) / sizeof(ANGLE_RESOLUTIONS[0]); ++i)
+    {
+      grasp_data_.angle_resolution_ = ANGLE_RESOLUTIONS[i];
+      benchmarkTemplate();
+      benchmarkTransform();
+      benchmarkConversion();
+      benchmarkCore();
+      benchmarkGenerateGrasps();
+    }
+  }
+
+  /**
+   * \brief The block-frame grasp poses of the sweeps, which do not depend on the block's pose. Only the
+   *        geometry, without scoring, ids or the transform to a block
+   */
+  void benchmarkTemplate()
+  {
+    block_grasp_generator::GraspGeometry geometry;
+    block_grasp_generator::BlockGraspGenerator::getGraspGeometry(grasp_data_, geometry);
+
+    // Same sweeps as GraspGeneratorCore::generateGrasps()
+    static const block_grasp_generator::grasp_axis_t SWEEP_AXES[] =
+      {block_grasp_generator::X_AXIS, block_grasp_generator::X_AXIS,
+       block_grasp_generator::Y_AXIS, block_grasp_generator::Y_AXIS};
+    static const block_grasp_generator::grasp_direction_t SWEEP_DIRECTIONS[] =
+      {block_grasp_generator::DOWN, block_grasp_generator::UP,
+       block_grasp_generator::DOWN, block_grasp_generator::UP};
+
+    std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > templates;
+    templates.reserve(4 * (geometry.angle_resolution_ + 1));
+
+    Eigen::Affine3d grasp_pose;
+    std::size_t num_grasps = 0;
+    startStage();
+    for (std::size_t i = 0; i < block_poses_.size() * NUM_REPEATS; ++i)
+    {
+      templates.clear();
+      for (std::size_t sweep = 0; sweep < 4; ++sweep)
+        for (int angle = 0; angle <= geometry.angle_resolution_; ++angle)
+        {
+          block_grasp_generator::GraspGeneratorCore::computeBlockGraspPose(SWEEP_AXES[sweep],
+            SWEEP_DIRECTIONS[sweep], angle * M_PI / geometry.angle_resolution_, geometry.grasp_depth_,
+            grasp_pose);
+          templates.push_back(grasp_pose * geometry.grasp_pose_to_eef_pose_);
+        }
+      num_grasps += templates.size();
+    }
+    stopStage("template", num_grasps);
+  }
+
+  /**
+   * \brief Moving the block-frame candidates to each block
+   */
+  void benchmarkTransform()
+  {
+    block_grasp_generator::GraspGeometry geometry;
+    block_grasp_generator::BlockGraspGenerator::getGraspGeometry(grasp_data_, geometry);
+
+    block_grasp_generator::GraspCandidates templates;
+    generator_core_.generateGrasps(Eigen::Affine3d::Identity(), geometry, 0, templates);
+    block_grasp_generator::GraspCandidates candidates = templates;
+
+    std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > block_transforms(block_poses_.size());
+    for (std::size_t i = 0; i < block_poses_.size(); ++i)
+      tf::poseMsgToEigen(block_poses_[i], block_transforms[i]);
+
+    std::size_t num_grasps = 0;
+    startStage();
+    for (std::size_t i = 0; i < block_poses_.size() * NUM_REPEATS; ++i)
+    {
+      const Eigen::Affine3d& block_transform = block_transforms[i % block_transforms.size()];
+      for (std::size_t j = 0; j < templates.size(); ++j)
+        candidates[j].grasp_pose_ = block_transform * templates[j].grasp_pose_;
+      num_grasps += candidates.size();
+    }
+    stopStage("transform", num_grasps);
+  }
+
+  /**
+   * \brief Conversion of candidates to moveit_msgs::Grasp
+   */
+  void benchmarkConversion()
+  {
+    block_grasp_generator::GraspGeometry geometry;
+    block_grasp_generator::BlockGraspGenerator::getGraspGeometry(grasp_data_, geometry);
+
+    std::vector<block_grasp_generator::GraspCandidates> candidates(block_poses_.size());
+    for (std::size_t i = 0; i < block_poses_.size(); ++i)
+    {
+      Eigen::Affine3d block_transform;
+      tf::poseMsgToEigen(block_poses_[i], block_transform);
+      generator_core_.generateGrasps(block_transform, geometry, i, candidates[i]);
+    }
+
+    std::vector<moveit_msgs::Grasp> possible_grasps;
+    std::size_t num_grasps = 0;
+    startStage();
+    for (std::size_t i = 0; i < block_poses_.size() * NUM_REPEATS; ++i)
+    {
+      possible_grasps.clear();
+      block_grasp_generator::BlockGraspGenerator::convertGrasps(candidates[i % candidates.size()], grasp_data_,
+                                                                possible_grasps);
+      num_grasps += possible_grasps.size();
+    }
+    stopStage("convert", num_grasps);
+  }
+
+  /**
+   * \brief Generation in the core, without ordering, symmetry removal or messages
+   */
+  void benchmarkCore()
+  {
+    block_grasp_generator::GraspGeometry geometry;
+    block_grasp_generator::BlockGraspGenerator::getGraspGeometry(grasp_data_, geometry);
+
+    std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > block_transforms(block_poses_.size());
+    for (std::size_t i = 0; i < block_poses_.size(); ++i)
+      tf::poseMsgToEigen(block_poses_[i], block_transforms[i]);
+
+    block_grasp_generator::GraspCandidates candidates;
+    candidates.reserve(block_grasp_generator::GraspGeneratorCore::getNumGrasps(geometry));
+
+    std::size_t num_grasps = 0;
+    startStage();
+    for (std::size_t i = 0; i < block_poses_.size() * NUM_REPEATS; ++i)
+    {
+      candidates.clear();
+      generator_core_.generateGrasps(block_transforms[i % block_transforms.size()], geometry, i, candidates);
+      num_grasps += candidates.size();
+    }
+    stopStage("core", num_grasps);
+  }
+
+  /**
+   * \brief The whole of BlockGraspGenerator::generateGrasps(), as the pick and place pipeline calls it
+   */
+  void benchmarkGenerateGrasps()
+  {
+    std::vector<moveit_msgs::Grasp> possible_grasps;
+    std::size_t num_grasps = 0;
+    startStage();
+    for (std::size_t i = 0; i < block_poses_.size() * NUM_REPEATS; ++i)
+    {
+      possible_grasps.clear();
+      block_grasp_generator_->generateGrasps(block_poses_[i % block_poses_.size()], grasp_data_, possible_grasps);
+      num_grasps += possible_grasps.size();
+    }
+    stopStage("generateGrasps", num_grasps);
+  }
+
+  void startStage()
+  {
+    start_allocations_ = block_grasp_generator::getNumAllocations();
+    start_time_ = ros::WallTime::now();
+  }
+
+  void stopStage(const std::string& stage, std::size_t num_grasps)
+  {
+    StageResult result;
+    result.seconds_ = (ros::WallTime::now() - start_time_).toSec();
+    result.num_allocations_ = block_grasp_generator::getNumAllocations() - start_allocations_;
+    result.stage_ = stage;
+    result.angle_resolution_ = grasp_data_.angle_resolution_;
+    result.num_grasps_ = num_grasps;
+    results_.push_back(result);
+
+    ROS_INFO_STREAM_NAMED("benchmark", stage << " at angle resolution " << result.angle_resolution_ << ": "
+                          << result.seconds_ * 1e9 / std::max<std::size_t>(num_grasps, 1) << " ns/grasp");
+  }
+
+  /**
+   * \brief One line per stage and angle resolution
+   */
+  void writeResults(std::ostream& out) const
+  {
+    out << "stage,angle_resolution,blocks,repeats,grasps,total_ns,ns_per_grasp,allocations,allocations_per_grasp"
+        << std::endl;
+    for (std::size_t i = 0; i < results_.size(); ++i)
+    {
+      const StageResult& result = results_[i];
+      double num_grasps = std::max<std::size_t>(result.num_grasps_, 1);
+      out << result.stage_ << ","
+          << result.angle_resolution_ << ","
+          << block_poses_.size() << ","
+          << NUM_REPEATS << ","
+          << result.num_grasps_ << ","
+          << result.seconds_ * 1e9 << ","
+          << result.seconds_ * 1e9 / num_grasps << ","
+          << result.num_allocations_ << ","
+          << result.num_allocations_ / num_grasps << std::endl;
+    }
+  }
+
+}; // end of class
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+  ros::init(argc, argv, "grasp_generator_benchmark", ros::init_options::AnonymousName);
+
+  // The per-request log line would be part of the measurement
+  if( ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME ".grasp", ros::console::levels::Warn) )
+    ros::console::notifyLoggerLevelsChanged();
+
+  baxter_pick_place::GraspGeneratorBenchmark benchmark;
+  benchmark.run();
+
+  if( argc > 1 )
+  {
+    std::ofstream file(argv[1]);
+    if( !file )
+    {
+      ROS_ERROR_STREAM_NAMED("benchmark","Unable to write " << argv[1]);
+      return 1;
+    }
+    benchmark.writeResults(file);
+  }
+  else
+    benchmark.writeResults(std::cout);
+
+  return 0;
+}
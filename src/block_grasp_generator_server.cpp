@@ -44,6 +44,8 @@
 
 // Grasp generation
 #include <block_grasp_generator/block_grasp_generator.h>
+#include <block_grasp_generator/grasp_filter.h>
+#include <block_grasp_generator/multi_arm_evaluator.h>
 #include <block_grasp_generator/GenerateBlockGraspsAction.h>
 
 
@@ -63,63 +65,277 @@ namespace block_grasp_generator
     // Action server
     actionlib::SimpleActionServer<block_grasp_generator::GenerateBlockGraspsAction> as_;
     block_grasp_generator::GenerateBlockGraspsResult result_;
+    block_grasp_generator::GenerateBlockGraspsFeedback feedback_;
 
     // Grasp generator
     block_grasp_generator::BlockGraspGeneratorPtr block_grasp_generator_;
 
+    // Optional kinematic filter of every arm. All arms are evaluated at once and feasible grasps are streamed
+    // as feedback
+    block_grasp_generator::MultiArmGraspEvaluatorPtr evaluator_;
+    std::vector<std::vector<moveit_msgs::Grasp> > arm_grasps_; // per arm, of the current request
+
     // class for publishing stuff to rviz
     moveit_visual_tools::VisualToolsPtr visual_tools_;
 
-    // robot-specific data for generating grasps
-    block_grasp_generator::RobotGraspData grasp_data_;
+    // which arms are we using, and the robot-specific data for generating their grasps
+    std::vector<std::string> sides_;
+    std::vector<block_grasp_generator::RobotGraspData> grasp_data_;
+
+    // makes the ids of every request's grasps unique
+    uint32_t next_request_id_;
+
+    // latency of every stage of the generator and the filter, on /diagnostics
+    block_grasp_generator::GraspStatisticsPublisherPtr statistics_publisher_;
 
-    // which arm are we using
-    std::string side_;
-    std::string planning_group_name_;
+    // where the span trace is written, at shutdown and after every request slower than trace_slow_request_
+    std::string trace_file_;
+    double trace_slow_request_;
+
+    // where the filter's IK solve times are kept between runs, empty to not keep them
+    std::string ik_timeout_file_;
 
   public:
 
     // Constructor
-    GraspGeneratorServer(const std::string &name, const std::string &side)
+    GraspGeneratorServer(const std::string &name, const std::string &default_side)
       : nh_("~")
       , as_(nh_, name, boost::bind(&block_grasp_generator::GraspGeneratorServer::executeCB, this, _1), false)
-      , side_(side)
-      , planning_group_name_(side_+"_arm")
+      , next_request_id_(0)
     {
+      // ---------------------------------------------------------------------------------------------
+      // Which arms to use, e.g. [left, right] to have every request recommend one
+      nh_.param("arms", sides_, std::vector<std::string>(1, default_side));
+      if( sides_.empty() )
+        sides_.push_back(default_side);
+
       // ---------------------------------------------------------------------------------------------
       // Load grasp data specific to our robot
-      grasp_data_ = reem_pick_place::loadRobotGraspData(side_); // Load robot specific data
+      for (std::size_t i = 0; i < sides_.size(); ++i)
+        grasp_data_.push_back(reem_pick_place::loadRobotGraspData(sides_[i])); // Load robot specific data
+
+      // Refine the angles that are feasible up to PI/max_angle_resolution, only when filtering. 0 to disable
+      int max_angle_resolution;
+      nh_.param("max_angle_resolution", max_angle_resolution, 0);
+      if( max_angle_resolution > block_grasp_generator::GraspId::MAX_ANGLE_RESOLUTION )
+      {
+        ROS_WARN_STREAM_NAMED("server","max_angle_resolution is above "
+                              << block_grasp_generator::GraspId::MAX_ANGLE_RESOLUTION << ", limiting it");
+        max_angle_resolution = block_grasp_generator::GraspId::MAX_ANGLE_RESOLUTION;
+      }
+      for (std::size_t i = 0; i < grasp_data_.size(); ++i)
+        grasp_data_[i].max_angle_resolution_ = max_angle_resolution;
 
       // ---------------------------------------------------------------------------------------------
       // Load the Robot Viz Tools for publishing to Rviz
       visual_tools_.reset(new moveit_visual_tools::VisualTools(reem_pick_place::BASE_LINK));
       visual_tools_->setLifetime(120.0);
       visual_tools_->setMuted(false);
-      visual_tools_->setEEGroupName(grasp_data_.ee_group_);
-      visual_tools_->setPlanningGroupName(planning_group_name_);
+      visual_tools_->setEEGroupName(grasp_data_[0].ee_group_);
+      visual_tools_->setPlanningGroupName(sides_[0] + "_arm");
 
       // ---------------------------------------------------------------------------------------------
       // Load grasp generator
       block_grasp_generator_.reset( new block_grasp_generator::BlockGraspGenerator(visual_tools_) );
+
+      // ---------------------------------------------------------------------------------------------
+      // Load a grasp filter for every arm
+      bool filter_grasps;
+      nh_.param("filter_grasps", filter_grasps, false);
+
+      // Learn which slots of the sweeps are feasible in this cell and skip the ones that never are. Only the
+      // filters find out what is feasible
+      bool prune_slots;
+      nh_.param("prune_slots", prune_slots, false);
+      if( prune_slots && !filter_grasps )
+      {
+        ROS_WARN_STREAM_NAMED("server","prune_slots needs filter_grasps, not pruning");
+        prune_slots = false;
+      }
+
+      if( filter_grasps )
+      {
+        // Stop once an arm has this many grasps scoring at least min_grasp_quality
+        block_grasp_generator::MultiArmSettings multi_arm_settings;
+        int enough_grasps;
+        nh_.param("enough_grasps", enough_grasps, 0);
+        multi_arm_settings.enough_grasps_ = std::max(0, enough_grasps);
+        nh_.param("min_grasp_quality", multi_arm_settings.min_quality_, 0.0);
+        evaluator_.reset( new block_grasp_generator::MultiArmGraspEvaluator(multi_arm_settings) );
+
+        double log_summary_period;
+        nh_.param("log_summary_period", log_summary_period, 10.0);
+
+        // Learn the IK timeouts per region, starting with the solve times learned in previous runs. The model
+        // keeps the arms apart by planning group
+        bool learn_ik_timeouts;
+        nh_.param("learn_ik_timeouts", learn_ik_timeouts, false);
+        block_grasp_generator::IkTimeoutModelPtr timeout_model;
+        if( learn_ik_timeouts )
+        {
+          timeout_model.reset(new block_grasp_generator::IkTimeoutModel());
+          nh_.param("ik_timeout_file", ik_timeout_file_, std::string(""));
+          if( !ik_timeout_file_.empty() && !timeout_model->load(ik_timeout_file_) )
+            ROS_WARN_STREAM_NAMED("server","Unable to load IK solve times from " << ik_timeout_file_);
+        }
+
+        // The arms run at once, share the cores between their solver pools
+        block_grasp_generator::ConcurrencySettings concurrency_settings;
+        if( sides_.size() > 1 )
+          concurrency_settings.max_threads_ = std::max(1, int(boost::thread::hardware_concurrency() / sides_.size()));
+
+        for (std::size_t i = 0; i < sides_.size(); ++i)
+        {
+          block_grasp_generator::GraspFilterPtr grasp_filter(
+            new block_grasp_generator::GraspFilter(reem_pick_place::BASE_LINK, false, visual_tools_,
+                                                   sides_[i] + "_arm") );
+          grasp_filter->loadWorkerScheduling(ros::NodeHandle(nh_, "ik_workers"));
+          grasp_filter->setConcurrencySettings(concurrency_settings);
+          grasp_filter->setStatistics(block_grasp_generator_->getStatistics());
+          grasp_filter->setLogSummaryPeriod(log_summary_period);
+          grasp_filter->setTimeoutModel(timeout_model);
+
+          // Every arm learns its own slots
+          if( prune_slots )
+            grasp_filter->setSlotHistory(block_grasp_generator::GraspSlotHistoryPtr(
+              new block_grasp_generator::GraspSlotHistory()));
+
+          evaluator_->addArm(sides_[i], grasp_data_[i], grasp_filter);
+        }
+        arm_grasps_.resize(sides_.size());
+
+        // Two mirror-symmetric arms: solve the first one and seed the second with its mirrored solutions. Per
+        // joint of the planning group, -1 where the second arm turns the other way. Empty to solve both in full
+        std::vector<double> mirror_joint_signs;
+        nh_.param("mirror_joint_signs", mirror_joint_signs, std::vector<double>());
+        if( !mirror_joint_signs.empty() )
+        {
+          if( sides_.size() == 2 )
+          {
+            block_grasp_generator::ArmSymmetry symmetry;
+            symmetry.joint_signs_ = mirror_joint_signs;
+            evaluator_->setArmSymmetry(0, 1, symmetry);
+          }
+          else
+            ROS_WARN_STREAM_NAMED("server","mirror_joint_signs needs exactly two arms, not mirroring");
+        }
+      }
+
+      // ---------------------------------------------------------------------------------------------
+      // Publish the statistics
+      std::string planning_groups = sides_[0] + "_arm";
+      for (std::size_t i = 1; i < sides_.size(); ++i)
+        planning_groups += ", " + sides_[i] + "_arm";
+      double statistics_period;
+      nh_.param("statistics_period", statistics_period, 1.0);
+      if( statistics_period > 0 )
+        statistics_publisher_.reset( new block_grasp_generator::GraspStatisticsPublisher(
+          block_grasp_generator_->getStatistics(), "block_grasp_generator: " + planning_groups,
+          statistics_period) );
+
+      // ---------------------------------------------------------------------------------------------
+      // Trace the last spans, for looking at slow requests in chrome://tracing
+      int trace_capacity;
+      nh_.param("trace_capacity", trace_capacity, 0);
+      nh_.param("trace_file", trace_file_, std::string("/tmp/block_grasp_generator_trace.json"));
+      nh_.param("trace_slow_request", trace_slow_request_, 0.0);
+      if( trace_capacity > 0 )
+        GraspTracer::enable(trace_capacity);
+
       as_.start();
     }
 
+    // Destructor
+    ~GraspGeneratorServer()
+    {
+      if( GraspTracer::isEnabled() )
+        GraspTracer::writeChromeTrace(trace_file_);
+
+      if( evaluator_ && !ik_timeout_file_.empty() &&
+          !evaluator_->getFilter(0)->getTimeoutModel()->save(ik_timeout_file_) )
+        ROS_WARN_STREAM_NAMED("server","Unable to save IK solve times to " << ik_timeout_file_);
+    }
+
     void executeCB(const block_grasp_generator::GenerateBlockGraspsGoalConstPtr &goal)
     {
+      ros::WallTime start_time = ros::WallTime::now();
+      if( GraspTracer::isEnabled() )
+        GraspTracer::setThreadName("action server");
+
+      executeGoal(goal);
+
+      // Keep the trace of a slow request before newer spans push it out of the buffer
+      double duration = (ros::WallTime::now() - start_time).toSec();
+      if( GraspTracer::isEnabled() && trace_slow_request_ > 0 && duration > trace_slow_request_ )
+      {
+        ROS_WARN_STREAM_NAMED("server","Request took " << duration << " s, writing trace " << trace_file_);
+        GraspTracer::writeChromeTrace(trace_file_);
+      }
+    }
+
+    void executeGoal(const block_grasp_generator::GenerateBlockGraspsGoalConstPtr &goal)
+    {
+      GRASP_TRACE_SPAN("executeCB");
+
       // ---------------------------------------------------------------------------------------------
       // Remove previous results
       result_.grasps.clear();
+      result_.arms.clear();
+      result_.num_grasps.clear();
+      result_.arm.clear();
 
       // ---------------------------------------------------------------------------------------------
       // Set object width and generate grasps
-      grasp_data_.block_size_ = goal->width;
-      block_grasp_generator_->generateGrasps(goal->pose, grasp_data_, result_.grasps);
+      for (std::size_t i = 0; i < grasp_data_.size(); ++i)
+        grasp_data_[i].block_size_ = goal->width;
+      if( evaluator_ )
+      {
+        // Only feasible grasps of all arms at once, each one is sent as feedback as soon as it is found
+        for (std::size_t i = 0; i < arm_grasps_.size(); ++i)
+          arm_grasps_[i].clear();
+        Eigen::Affine3d block_pose;
+        tf::poseMsgToEigen(goal->pose, block_pose);
+        int arm = evaluator_->evaluate(block_pose, next_request_id_++,
+                                       boost::bind(&GraspGeneratorServer::feasibleGraspCB, this, _1, _2, _3));
+        if( arm >= 0 )
+          result_.arm = sides_[arm];
+
+        for (std::size_t i = 0; i < arm_grasps_.size(); ++i)
+        {
+          result_.grasps.insert(result_.grasps.end(), arm_grasps_[i].begin(), arm_grasps_[i].end());
+          result_.arms.push_back(sides_[i]);
+          result_.num_grasps.push_back(arm_grasps_[i].size());
+        }
+      }
+      else
+      {
+        // Nothing to choose an arm by without the filter, recommend the first one
+        for (std::size_t i = 0; i < sides_.size(); ++i)
+        {
+          std::size_t num_grasps = result_.grasps.size();
+          block_grasp_generator_->generateGrasps(goal->pose, grasp_data_[i], result_.grasps);
+          result_.arms.push_back(sides_[i]);
+          result_.num_grasps.push_back(result_.grasps.size() - num_grasps);
+        }
+        result_.arm = sides_[0];
+      }
 
       // ---------------------------------------------------------------------------------------------
       // Publish results
       as_.setSucceeded(result_);
     }
 
+    // Called by the evaluator one grasp at a time
+    void feasibleGraspCB(std::size_t arm, const GraspCandidate& candidate, const double* solution)
+    {
+      GRASP_TRACE_SPAN("feedback");
+      feedback_.grasps.resize(1);
+      BlockGraspGenerator::convertGrasp(candidate, grasp_data_[arm], feedback_.grasps[0]);
+      feedback_.arm = sides_[arm];
+      arm_grasps_[arm].push_back(feedback_.grasps[0]);
+      as_.publishFeedback(feedback_);
+    }
+
   };
 }
 
@@ -75,10 +75,12 @@ public:
 
   // Constructor
   GraspGeneratorTest(int num_tests)
-    : nh_("~"),
-      arm_("right"),
-      planning_group_name_(arm_+"_arm")
+    : nh_("~")
   {
+    // Which arm to test, e.g. _arm:=left
+    nh_.param("arm", arm_, std::string("right"));
+    planning_group_name_ = arm_ + "_arm";
+
     // ---------------------------------------------------------------------------------------------
     // Load grasp data specific to our robot
     grasp_data_ = baxter_pick_place::loadRobotGraspData(arm_, BLOCK_SIZE); // Load robot specific data
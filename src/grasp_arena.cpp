@@ -0,0 +1,93 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <block_grasp_generator/grasp_arena.h>
+
+#include <algorithm>
+
+namespace block_grasp_generator
+{
+
+// Constructor
+GraspArena::GraspArena() :
+  num_joints_(0)
+{
+}
+
+// Deconstructor
+GraspArena::~GraspArena()
+{
+}
+
+void GraspArena::reset()
+{
+  // clear() keeps the capacity of the vectors
+  candidates_.clear();
+  filtered_ids_.clear();
+}
+
+void GraspArena::reserve(std::size_t num_candidates, std::size_t num_joints)
+{
+  num_joints_ = num_joints;
+  candidates_.reserve(num_candidates);
+  filtered_ids_.reserve(num_candidates);
+
+  // Solutions are addressed by index so they need to exist, not just be reserved
+  if( solutions_.size() < num_candidates * num_joints_ )
+    solutions_.resize(num_candidates * num_joints_);
+  if( ik_tiers_.size() < num_candidates )
+    ik_tiers_.resize(num_candidates, -1);
+}
+
+void GraspArena::clearIkTiers(std::size_t first_id, std::size_t end_id)
+{
+  std::fill(ik_tiers_.begin() + first_id, ik_tiers_.begin() + end_id, -1);
+}
+
+void GraspArena::compact()
+{
+  // Ids are sorted so an id is never smaller than its position and we can move forward in place
+  for (std::size_t i = 0; i < filtered_ids_.size(); ++i)
+  {
+    std::size_t id = filtered_ids_[i];
+    if( id == i )
+      continue;
+    candidates_[i] = candidates_[id];
+    std::copy(getSolution(id), getSolution(id) + num_joints_, getSolution(i));
+    ik_tiers_[i] = ik_tiers_[id];
+  }
+  candidates_.resize(filtered_ids_.size());
+}
+
+} // namespace
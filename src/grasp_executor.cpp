@@ -0,0 +1,91 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <block_grasp_generator/grasp_executor.h>
+#include <block_grasp_generator/grasp_trace.h>
+
+namespace block_grasp_generator
+{
+
+// Constructor
+GraspExecutor::GraspExecutor() :
+  shutdown_(false)
+{
+  thread_ = boost::thread(boost::bind(&GraspExecutor::run, this));
+}
+
+// Destructor
+GraspExecutor::~GraspExecutor()
+{
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    shutdown_ = true;
+    tasks_cond_.notify_all();
+  }
+  thread_.join();
+}
+
+void GraspExecutor::post(const boost::function<void()>& task)
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  tasks_.push_back(task);
+  tasks_cond_.notify_one();
+}
+
+void GraspExecutor::run()
+{
+  GraspTracer::setThreadName("grasp executor");
+
+  while(true)
+  {
+    boost::function<void()> task;
+    {
+      boost::mutex::scoped_lock slock(mutex_);
+      while( tasks_.empty() && !shutdown_ )
+        tasks_cond_.wait(slock);
+
+      // Only stop once everything queued has run, pending futures would never be ready otherwise
+      if( tasks_.empty() )
+        return;
+
+      task.swap(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    GRASP_TRACE_SPAN("executor task");
+    task();
+  }
+}
+
+} // namespace
@@ -34,14 +34,47 @@
 
 #include <block_grasp_generator/grasp_filter.h>
 
+#include <algorithm>
+#include <sstream>
+#include <stdlib.h>
+
 namespace block_grasp_generator
 {
 
+namespace
+{
+
+// The log summary adds these to the IK outcomes
+enum
+{
+  SUMMARY_CANDIDATES = NUM_GRASP_COUNTERS,
+  SUMMARY_FEASIBLE,
+  NUM_SUMMARY_COUNTS
+};
+
+} // namespace
+
 // Constructor
 GraspFilter::GraspFilter( const std::string& base_link, bool rviz_verbose,
                           moveit_visual_tools::VisualToolsPtr rviz_tools, const std::string& planning_group ):
   base_link_(base_link),
   planning_group_(planning_group),
+  workers_job_count_(0),
+  workers_active_(0),
+  workers_running_(0),
+  workers_shutdown_(false),
+  cancelled_(false),
+  pool_changed_(false),
+  ik_latency_estimate_(0),
+  seed_database_(new IkSeedDatabase()),
+  timeout_model_(),
+  ik_timeout_(0.05),
+  ik_tiers_(1, IkTier()),
+  ik_tiers_changed_(false),
+  hedge_cpu_used_(0),
+  statistics_(new GraspStatistics()),
+  log_summary_(10.0, NUM_SUMMARY_COUNTS),
+  arena_seeded_end_(0),
   rviz_verbose_(rviz_verbose),
   visual_tools_(rviz_tools)
 {
@@ -51,8 +84,40 @@ GraspFilter::GraspFilter( const std::string& base_link, bool rviz_verbose,
   robot_model_ = visual_tools_->getPlanningSceneMonitor()->getPlanningScene()->getRobotModel();
 }
 
+GraspFilter::GraspFilter( const std::string& base_link, robot_model::RobotModelConstPtr robot_model,
+                          const std::string& planning_group ):
+  robot_model_(robot_model),
+  base_link_(base_link),
+  planning_group_(planning_group),
+  workers_job_count_(0),
+  workers_active_(0),
+  workers_running_(0),
+  workers_shutdown_(false),
+  cancelled_(false),
+  pool_changed_(false),
+  ik_latency_estimate_(0),
+  seed_database_(new IkSeedDatabase()),
+  timeout_model_(),
+  ik_timeout_(0.05),
+  ik_tiers_(1, IkTier()),
+  ik_tiers_changed_(false),
+  hedge_cpu_used_(0),
+  statistics_(new GraspStatistics()),
+  log_summary_(10.0, NUM_SUMMARY_COUNTS),
+  arena_seeded_end_(0),
+  rviz_verbose_(false)
+{
+  default_state_.reset(new robot_state::RobotState(robot_model_));
+  default_state_->setToDefaultValues();
+
+  ROS_INFO_STREAM_NAMED("grasp","GraspFilter ready without a planning scene.");
+}
+
 GraspFilter::~GraspFilter()
 {
+  // Finish the queued requests while the workers still exist
+  executor_.reset();
+  stopIkWorkers();
 }
 
 bool GraspFilter::chooseBestGrasp( const std::vector<moveit_msgs::Grasp>& possible_grasps, moveit_msgs::Grasp& chosen )
@@ -70,182 +135,1253 @@ bool GraspFilter::chooseBestGrasp( const std::vector<moveit_msgs::Grasp>& possib
 // Return grasps that are kinematically feasible
 bool GraspFilter::filterGrasps(std::vector<moveit_msgs::Grasp>& possible_grasps)
 {
+  // Only the poses are needed for IK
+  arena_.reset();
+  GraspCandidates& candidates = arena_.getCandidates();
+  candidates.resize(possible_grasps.size());
+  for (std::size_t i = 0; i < possible_grasps.size(); ++i)
+    tf::poseMsgToEigen(possible_grasps[i].grasp_pose.pose, candidates[i].grasp_pose_);
+
+  if( !filterGraspIds(arena_, 0) )
+    return false;
+
+  const std::vector<std::size_t>& filtered_ids = arena_.getFilteredIds();
+  std::vector<moveit_msgs::Grasp> filtered_grasps;
+  filtered_grasps.reserve(filtered_ids.size());
+  for (std::size_t i = 0; i < filtered_ids.size(); ++i)
+    filtered_grasps.push_back(possible_grasps[filtered_ids[i]]);
+  possible_grasps.swap(filtered_grasps);
+
+  GRASP_LOG_DEBUG_STREAM("grasp","Possible grasps filtered to " << possible_grasps.size() << " options.");
+
+  return true;
+}
+
+// Return candidates that are kinematically feasible
+bool GraspFilter::filterGrasps(GraspCandidates& possible_grasps)
+{
+  // Borrow the memory of our own arena, swapping does not copy
+  arena_.reset();
+  arena_.getCandidates().swap(possible_grasps);
+  bool result = filterArena(arena_, NULL);
+  arena_.getCandidates().swap(possible_grasps);
+
+  return result;
+}
+
+// Return candidates of a block that are kinematically feasible
+bool GraspFilter::filterGrasps(const Eigen::Affine3d& block_pose, GraspCandidates& possible_grasps)
+{
+  arena_.reset();
+  arena_.getCandidates().swap(possible_grasps);
+  bool result = filterArena(arena_, &block_pose);
+  arena_.getCandidates().swap(possible_grasps);
+
+  return result;
+}
+
+// Return candidates that are kinematically feasible, with their IK solutions
+bool GraspFilter::filterGrasps(GraspArena& arena)
+{
+  return filterArena(arena, NULL);
+}
+
+// Return candidates of a block that are kinematically feasible, with their IK solutions
+bool GraspFilter::filterGrasps(const Eigen::Affine3d& block_pose, GraspArena& arena)
+{
+  return filterArena(arena, &block_pose);
+}
+
+// Body of the filterGrasps() overloads that take an arena
+bool GraspFilter::filterArena(GraspArena& arena, const Eigen::Affine3d* block_pose)
+{
+  arena.getFilteredIds().clear();
+  if( !filterGraspIds(arena, 0, block_pose) )
+    return false;
+
+  arena.compact();
+
+  GRASP_LOG_DEBUG_STREAM("grasp","Possible grasps filtered to " << arena.getCandidates().size() << " options.");
+
+  return true;
+}
+
+// Non-blocking filtering of candidates that are still being generated
+boost::shared_future<GraspArenaPtr> GraspFilter::filterGraspsAsync(const boost::shared_future<GraspArenaPtr>& candidates)
+{
+  return getExecutor()->then<GraspArenaPtr, GraspArenaPtr>(candidates,
+    boost::bind(&GraspFilter::filterGraspsTask, this, _1));
+}
+
+// Non-blocking filtering
+boost::shared_future<GraspArenaPtr> GraspFilter::filterGraspsAsync(GraspArenaPtr arena)
+{
+  return getExecutor()->submit<GraspArenaPtr>(boost::bind(&GraspFilter::filterGraspsTask, this, arena));
+}
+
+// Body of filterGraspsAsync()
+GraspArenaPtr GraspFilter::filterGraspsTask(const GraspArenaPtr& arena)
+{
+  if( arena->getCandidates().empty() || !filterGrasps(*arena) )
+    arena->getCandidates().clear();
+  return arena;
+}
+
+// The thread asynchronous requests run on
+GraspExecutorPtr GraspFilter::getExecutor()
+{
+  if( !executor_ )
+    executor_.reset(new GraspExecutor());
+  return executor_;
+}
+
+// Coarse-to-fine filtering
+bool GraspFilter::filterGraspsAdaptive(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+  uint32_t request_id, GraspArena& arena)
+{
+  arena.getFilteredIds().clear();
+
+  std::size_t first_id = 0;
+  int resolution = geometry.angle_resolution_;
+  while(true)
+  {
+    if( !filterGraspIds(arena, first_id, &block_pose) )
+      return false;
+
+    resolution *= 2;
+    if( resolution > geometry.max_angle_resolution_ || resolution > GraspId::MAX_ANGLE_RESOLUTION )
+      break;
+
+    // Refine around the angles that were feasible or scored highly in the last pass
+    const GraspCandidates& candidates = arena.getCandidates();
+    const std::vector<std::size_t>& filtered_ids = arena.getFilteredIds();
+    refine_parents_.clear();
+    for (std::size_t i = first_id; i < candidates.size(); ++i)
+    {
+      if( std::binary_search(filtered_ids.begin(), filtered_ids.end(), i) ||
+          ( geometry.refine_quality_threshold_ > 0 &&
+            candidates[i].grasp_quality_ >= geometry.refine_quality_threshold_ ) )
+        refine_parents_.push_back(candidates[i]);
+    }
+
+    first_id = candidates.size();
+    if( generator_core_.refineGrasps(block_pose, geometry, request_id, refine_parents_,
+                                     arena.getCandidates(), &arena.getScratch()) == 0 )
+      break;
+
+    GRASP_LOG_DEBUG_STREAM("grasp","Refined to " << arena.getCandidates().size() - first_id
+                           << " candidates at resolution " << resolution);
+  }
+
+  arena.compact();
+
+  GRASP_LOG_DEBUG_STREAM("grasp","Adaptive sampling filtered grasps to " << arena.getCandidates().size() << " options.");
+
+  return true;
+}
+
+// Keep the grasps of a tracked block up to date
+bool GraspFilter::updateTrackedGrasps(const std::string& object_id, const Eigen::Affine3d& block_pose,
+  const GraspGeometry& geometry, uint32_t request_id, GraspArena& arena)
+{
+  const std::size_t num_joints = robot_model_->getJointModelGroup(planning_group_)->getVariableCount();
+
+  TrackedObjectPtr& tracked = tracked_objects_[object_id];
+  bool coherent = tracked && isTracked(*tracked, block_pose);
+
+  arena.reset();
+  GraspCandidates& candidates = arena.getCandidates();
+
+  if( !coherent )
+  {
+    // New or moved too far: start from scratch
+    GRASP_LOG_DEBUG_STREAM("grasp","Generating grasps of " << object_id << " from scratch");
+
+    if( !generator_core_.generateGrasps(block_pose, geometry, request_id, candidates) )
+      return false;
+    generator_core_.orderByArmBase(block_pose, geometry, 0, candidates, &arena.getScratch());
+    tracked_variants_.clear();
+    generator_core_.removeSymmetricGrasps(block_pose, geometry, 0, candidates, tracked_variants_,
+                                          &arena.getScratch());
+
+    if( !tracked )
+      tracked.reset(new TrackedObject());
+    tracked->candidates_ = candidates;
+    const Eigen::Affine3d world_to_block = block_pose.inverse();
+    for (std::size_t i = 0; i < tracked->candidates_.size(); ++i)
+      tracked->candidates_[i].grasp_pose_ = world_to_block * candidates[i].grasp_pose_;
+    tracked->feasible_.assign(candidates.size(), 0);
+    tracked->solutions_.assign(candidates.size() * num_joints, 0.0);
+    tracked->next_candidate_ = 0;
+    tracked->scheduled_.resize(candidates.size());
+    for (std::size_t i = 0; i < candidates.size(); ++i)
+      tracked->scheduled_[i] = i;
+
+    arena.reserve(candidates.size(), num_joints);
+  }
+  else
+  {
+    // Check the grasps that were feasible again, then a few of the others
+    std::vector<std::size_t>& scheduled = tracked->scheduled_;
+    const std::size_t num_candidates = tracked->candidates_.size();
+    scheduled.clear();
+    for (std::size_t i = 0; i < num_candidates; ++i)
+      if( tracked->feasible_[i] )
+        scheduled.push_back(i);
+    std::size_t num_feasible = scheduled.size();
+
+    std::size_t checked = 0;
+    for (; checked < num_candidates && scheduled.size() - num_feasible < tracking_settings_.max_new_candidates_;
+         ++checked)
+    {
+      std::size_t i = (tracked->next_candidate_ + checked) % num_candidates;
+      if( !tracked->feasible_[i] )
+        scheduled.push_back(i);
+    }
+    if( num_candidates > 0 )
+      tracked->next_candidate_ = (tracked->next_candidate_ + checked) % num_candidates;
+
+    // Move the candidates with the block
+    arena.reserve(scheduled.size(), num_joints);
+    for (std::size_t i = 0; i < scheduled.size(); ++i)
+    {
+      candidates.push_back(tracked->candidates_[scheduled[i]]);
+      candidates.back().grasp_pose_ = block_pose * candidates.back().grasp_pose_;
+    }
+
+    // The previous solutions become the seeds
+    for (std::size_t i = 0; i < num_feasible; ++i)
+      std::copy(&tracked->solutions_[scheduled[i] * num_joints], &tracked->solutions_[scheduled[i] * num_joints] +
+                num_joints, arena.getSolution(i));
+    arena_seeded_end_ = num_feasible;
+
+    GRASP_LOG_DEBUG_STREAM("grasp","Tracking " << object_id << ": checking " << num_feasible
+                           << " feasible and " << scheduled.size() - num_feasible << " new candidates");
+  }
+
+  tracked->block_pose_ = block_pose;
+  if( candidates.empty() )
+    return true;
+
+  arena.getFilteredIds().clear();
+  bool result = filterGraspIds(arena, 0);
+  arena_seeded_end_ = 0;
+  if( !result )
+    return false;
+
+  // Remember what is feasible now for the next update
+  const std::vector<std::size_t>& filtered_ids = arena.getFilteredIds();
+  for (std::size_t i = 0; i < tracked->scheduled_.size(); ++i)
+  {
+    std::size_t candidate = tracked->scheduled_[i];
+    tracked->feasible_[candidate] = std::binary_search(filtered_ids.begin(), filtered_ids.end(), i);
+    if( tracked->feasible_[candidate] )
+      std::copy(arena.getSolution(i), arena.getSolution(i) + num_joints, &tracked->solutions_[candidate * num_joints]);
+  }
+
+  arena.compact();
+
+  GRASP_LOG_DEBUG_STREAM("grasp","Tracked grasps of " << object_id << " filtered to " << arena.getCandidates().size()
+                         << " options.");
+
+  return true;
+}
+
+// Evaluate a block for both arms of a mirror-symmetric robot
+bool GraspFilter::filterMirroredGrasps(const ArmSymmetry& symmetry, GraspFilter& mirrored_filter, GraspArena& arena,
+  GraspArena& mirrored_arena)
+{
+  GRASP_TRACE_SPAN("mirrored request");
+
+  const std::size_t num_joints = robot_model_->getJointModelGroup(planning_group_)->getVariableCount();
+  if( mirrored_filter.robot_model_->getJointModelGroup(mirrored_filter.planning_group_)->getVariableCount() !=
+      num_joints )
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter","Planning groups " << planning_group_ << " and "
+                           << mirrored_filter.planning_group_ << " do not have the same number of joints");
+    return false;
+  }
+
+  // This arm in full, which adds its solutions to the seed database
+  if( !filterGrasps(arena) )
+    return false;
+
+  // Split the other arm's candidates by whether this arm solved something close to their mirrored pose
+  GraspCandidates& candidates = mirrored_arena.getCandidates();
+  mirrored_candidates_.clear();
+  unseeded_candidates_.clear();
+  mirrored_seeds_.clear();
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+  {
+    double distance;
+    if( seed_database_ && seed_database_->findSeed(planning_group_, symmetry.mirrorPose(candidates[i].grasp_pose_),
+                                                   mirrored_seed_, &distance) &&
+        distance <= symmetry.max_seed_distance_ )
+    {
+      mirrored_candidates_.push_back(candidates[i]);
+      mirrored_seeds_.insert(mirrored_seeds_.end(), mirrored_seed_.begin(), mirrored_seed_.end());
+    }
+    else
+      unseeded_candidates_.push_back(candidates[i]);
+  }
+
+  // The mirrored candidates go first, seeded with the other arm's version of this arm's solution
+  const std::size_t num_candidates = candidates.size();
+  const std::size_t num_seeded = mirrored_candidates_.size();
+  candidates.swap(mirrored_candidates_);
+  candidates.reserve(num_candidates);
+  mirrored_arena.getFilteredIds().clear();
+  mirrored_arena.reserve(num_candidates, num_joints);
+  for (std::size_t i = 0; i < num_seeded; ++i)
+    symmetry.mirrorJoints(&mirrored_seeds_[i * num_joints], num_joints, mirrored_arena.getSolution(i));
+
+  if( num_seeded > 0 && !mirrored_filter.verifySeededGrasps(mirrored_arena, symmetry.verify_timeout_) )
+    return false;
+  GRASP_LOG_DEBUG_STREAM("grasp", "Verified " << mirrored_arena.getFilteredIds().size() << " of " << num_seeded
+                         << " mirrored grasps on " << mirrored_filter.planning_group_);
+
+  // The others, and the ones that did not verify, the hard way
+  if( symmetry.solve_unverified_ )
+  {
+    const std::vector<std::size_t>& filtered_ids = mirrored_arena.getFilteredIds();
+    for (std::size_t i = 0; i < num_seeded; ++i)
+      if( !std::binary_search(filtered_ids.begin(), filtered_ids.end(), i) )
+        unseeded_candidates_.push_back(candidates[i]);
+    candidates.insert(candidates.end(), unseeded_candidates_.begin(), unseeded_candidates_.end());
+
+    if( candidates.size() > num_seeded && !mirrored_filter.filterGraspIds(mirrored_arena, num_seeded) )
+      return false;
+  }
+
+  mirrored_arena.compact();
+  return true;
+}
+
+// Check seeded candidates with a fixed timeout
+bool GraspFilter::verifySeededGrasps(GraspArena& arena, double timeout)
+{
+  IkTimeoutModelPtr timeout_model = timeout_model_;
+  double ik_timeout = ik_timeout_;
+  timeout_model_.reset();
+  ik_timeout_ = timeout;
+  arena_seeded_end_ = arena.getCandidates().size();
+
+  bool result = filterGraspIds(arena, 0);
+
+  arena_seeded_end_ = 0;
+  timeout_model_ = timeout_model;
+  ik_timeout_ = ik_timeout;
+  return result;
+}
+
+// Whether a block moved little enough to keep tracking its grasps
+bool GraspFilter::isTracked(const TrackedObject& tracked, const Eigen::Affine3d& block_pose) const
+{
+  double distance = (block_pose.translation() - tracked.block_pose_.translation()).norm();
+  double angle = Eigen::AngleAxisd(tracked.block_pose_.rotation().transpose() * block_pose.rotation()).angle();
+  return distance <= tracking_settings_.position_tolerance_ && angle <= tracking_settings_.angle_tolerance_;
+}
+
+// Position of the root of the planning group
+bool GraspFilter::getArmBasePosition(Eigen::Vector3d& position) const
+{
+  const robot_model::JointModelGroup* joint_model_group = robot_model_->getJointModelGroup(planning_group_);
+  if( joint_model_group->getLinkModelNames().empty() )
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter","Planning group " << planning_group_ << " has no links");
+    return false;
+  }
+
+  const robot_state::RobotState& state = getCurrentState();
+  position = state.getGlobalLinkTransform(joint_model_group->getLinkModelNames().front()).translation();
+  return true;
+}
+
+// Find the kinematically feasible candidates
+bool GraspFilter::filterGraspIds(GraspArena& arena, std::size_t first_id, const Eigen::Affine3d* block_pose)
+{
+  const GraspCandidates& possible_grasps = arena.getCandidates();
+
   // -----------------------------------------------------------------------------------------------
   // Error check
-  if( possible_grasps.empty() )
+  if( possible_grasps.size() <= first_id )
   {
     ROS_ERROR_NAMED("grasp","Unable to filter grasps because vector is empty");
     return false;
   }
 
-  // -----------------------------------------------------------------------------------------------
-  // how many cores does this computer have and how many do we need?
-  int num_threads = boost::thread::hardware_concurrency();
-  if( num_threads > possible_grasps.size() )
-    num_threads = possible_grasps.size();
+  GRASP_TRACE_SPAN_ARG("filter request", "candidates", possible_grasps.size() - first_id);
 
-  if(true)
+  int num_threads;
+  double timeout;
+  if( !prepareIkRequest(arena, first_id, possible_grasps.size(), false, num_threads, timeout) )
+    return false;
+
+  ros::WallTime start_time = ros::WallTime::now();
   {
-    num_threads = 1;
-    ROS_ERROR_STREAM_NAMED("grasp_filter","Using " << num_threads << " threads");
+
+    // -----------------------------------------------------------------------------------------------
+    // Loop through poses and find those that are kinematically feasible
+    boost::mutex lock; // used for sharing the same data structures
+
+    GRASP_LOG_DEBUG_STREAM("grasp", "Filtering possible grasps with " << num_threads << " threads, racing "
+                           << getNumSeeds(false) << " seeds per grasp");
+
+    assignIkJobs(arena, first_id, possible_grasps.size(), num_threads, timeout, &lock, false);
+
+    // Wake up the workers and wait for them to finish
+    runIkJobs(num_threads * getNumSeeds(false));
+    statistics_->recordStage(STAGE_IK_REQUEST, (ros::WallTime::now() - start_time).toSec());
+
+    finishIkRequest(arena, first_id, block_pose);
+  }
+
+  return true;
+}
+
+// Generate the candidates of a block with the prefilters of BlockGraspGenerator
+bool GraspFilter::generateGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+  uint32_t request_id, GraspArena& arena)
+{
+  arena.reset();
+  GraspCandidates& candidates = arena.getCandidates();
+
+  ros::WallTime start_time = ros::WallTime::now();
+  {
+    GRASP_TRACE_SPAN_ARG("generate", "angle_resolution", geometry.angle_resolution_);
+    candidates.reserve(GraspGeneratorCore::getNumGrasps(geometry));
+    if( !generator_core_.generateGrasps(block_pose, geometry, request_id, candidates) )
+      return false;
+  }
+
+  ros::WallTime prefilter_time = ros::WallTime::now();
+  statistics_->recordStage(STAGE_GENERATE, (prefilter_time - start_time).toSec());
+  {
+    GRASP_TRACE_SPAN("prefilter");
+
+    std::size_t num_facing_away = generator_core_.orderByArmBase(block_pose, geometry, 0, candidates,
+                                                                 &arena.getScratch());
+    if( num_facing_away > 0 )
+      GRASP_LOG_DEBUG_STREAM("grasp","Dropped " << num_facing_away << " grasps facing away from the arm base");
+
+    symmetric_variants_.clear();
+    std::size_t num_symmetric = generator_core_.removeSymmetricGrasps(block_pose, geometry, 0, candidates,
+                                                                      symmetric_variants_, &arena.getScratch());
+    if( num_symmetric > 0 )
+      GRASP_LOG_DEBUG_STREAM("grasp","Dropped " << num_symmetric << " symmetric grasps");
+
+    if( slot_history_ )
+    {
+      std::size_t num_pruned = slot_history_->pruneGrasps(block_pose, 0, candidates);
+      if( num_pruned > 0 )
+        GRASP_LOG_DEBUG_STREAM("grasp","Pruned " << num_pruned << " grasps of rarely feasible slots");
+    }
+  }
+  statistics_->recordStage(STAGE_PREFILTER, (ros::WallTime::now() - prefilter_time).toSec());
+
+  return true;
+}
+
+// Whether streaming checks the same candidates as generating first
+bool GraspFilter::canStream(const GraspGeometry& geometry)
+{
+  return !geometry.face_arm_base_ && geometry.symmetry_angle_tolerance_ <= 0 &&
+    geometry.max_angle_resolution_ <= geometry.angle_resolution_;
+}
+
+// Generate and filter at the same time
+bool GraspFilter::streamGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry, uint32_t request_id,
+  const FeasibleGraspCallback& callback, GraspArena& arena)
+{
+  GRASP_TRACE_SPAN("stream request");
+
+  // The candidates must never be reallocated while the workers read them
+  std::size_t num_candidates = GraspGeneratorCore::getNumGrasps(geometry);
+  arena.reset();
+  arena.getCandidates().reserve(num_candidates);
+
+  int num_threads;
+  double timeout;
+  if( !prepareIkRequest(arena, 0, num_candidates, true, num_threads, timeout) )
+    return false;
+
+  // Results never wait for room, the queue can hold every candidate
+  candidate_queue_.reset(std::max(std::size_t(1), num_candidates / 4));
+  result_queue_.reset(num_candidates);
+
+  ros::WallTime start_time = ros::WallTime::now();
+  boost::mutex lock; // used for sharing the same data structures
+  assignIkJobs(arena, 0, 0, num_threads, timeout, &lock, true);
+  startIkJobs(num_threads);
+
+  GRASP_LOG_DEBUG_STREAM("grasp", "Streaming grasps to " << num_threads << " threads");
+
+  // Same sweeps as GraspGeneratorCore::generateGrasps()
+  static const grasp_axis_t SWEEP_AXES[] = {X_AXIS, X_AXIS, Y_AXIS, Y_AXIS};
+  static const grasp_direction_t SWEEP_DIRECTIONS[] = {DOWN, UP, DOWN, UP};
+
+  // Skip the slots that have almost never been feasible for blocks around here, or leave them for a second pass
+  bool prune = slot_history_ && slot_history_->getPrunedSlots(block_pose, pruned_slots_);
+  int num_passes = prune && !slot_history_->getSettings().drop_pruned_ ? 2 : 1;
+
+  GraspCandidates& candidates = arena.getCandidates();
+  std::size_t result;
+  bool generated = true;
+  for (int step = 0; step < 4 * num_passes && generated && !cancelled_; ++step)
+  {
+    int sweep = step % 4;
+    bool second_pass = step >= 4;
+    for (int angle = 0; angle <= geometry.angle_resolution_ && generated && !cancelled_; ++angle)
+    {
+      if( prune && bool(pruned_slots_[slot_history_->getSlot(SWEEP_AXES[sweep], SWEEP_DIRECTIONS[sweep], angle,
+                                                             geometry.angle_resolution_)]) != second_pass )
+        continue;
+
+      std::size_t first_id = candidates.size();
+      generated = generator_core_.generateAngleGrasps(block_pose, SWEEP_AXES[sweep], SWEEP_DIRECTIONS[sweep], angle,
+                                                      geometry.angle_resolution_, geometry, request_id, candidates);
+      for (std::size_t i = first_id; i < candidates.size(); ++i)
+        candidate_queue_.push(i);
+
+      // Deliver what is already feasible
+      while( result_queue_.tryPop(result) )
+        if( callback )
+          callback(candidates[result], arena.getSolution(result));
+    }
   }
+  candidate_queue_.close();
+
+  // The last worker to finish closes the result queue
+  while( result_queue_.pop(result) )
+    if( callback )
+      callback(candidates[result], arena.getSolution(result));
+  waitIkJobs();
+  statistics_->recordStage(STAGE_IK_REQUEST, (ros::WallTime::now() - start_time).toSec());
 
+  finishIkRequest(arena, 0, &block_pose);
+  arena.compact();
+
+  return generated;
+}
+
+// Load the solvers and reset the per request state
+bool GraspFilter::prepareIkRequest(GraspArena& arena, std::size_t first_id, std::size_t num_candidates,
+  bool streaming, int& num_threads, double& timeout)
+{
   // -----------------------------------------------------------------------------------------------
-  // Get the solver timeout from kinematics.yaml
-  //double timeout = planning_scene_monitor_->getPlanningScene()->getCurrentState().
-  //  getJointStateGroup(planning_group_)->getDefaultIKTimeout();
+  // Get the solver timeout, from kinematics.yaml unless set. The timeout model refines it per query
+  const robot_model::JointModelGroup* joint_model_group = robot_model_->getJointModelGroup(planning_group_);
+  timeout = ik_timeout_ > 0 ? ik_timeout_ : joint_model_group->getDefaultIKTimeout();
+  GRASP_LOG_DEBUG_STREAM("grasp_filter","Planning timeout " << timeout);
 
-  double timeout = robot_model_->getJointModelGroup( planning_group_ )->getDefaultIKTimeout();
-  ROS_INFO_STREAM_NAMED("grasp_filter","Planning timeout " << timeout);
-  timeout = 0.05;
+  // -----------------------------------------------------------------------------------------------
+  // how many cores does this computer have and how many do we need? The seeds of a grasp race on cores of
+  // the same budget, so every share of the work takes num_seeds of them
+  int num_seeds = getNumSeeds(streaming);
+  num_threads = std::max(1, chooseNumThreads(num_candidates - first_id, timeout) / num_seeds);
+  GRASP_LOG_DEBUG_STREAM("grasp_filter","Using " << num_threads * num_seeds << " threads");
 
   // -----------------------------------------------------------------------------------------------
-  // Load kinematic solvers if not already loaded
-  if( kin_solvers_.size() != num_threads )
+  // Load the solver pool if not already loaded. A share needs a solver for each of its seeds
+  std::size_t pool_size = std::max(getMaxThreads(), std::max(1, hedge_settings_.num_seeds_));
+  if( ik_workers_.size() != pool_size || ik_tiers_changed_ || pool_changed_ )
+  {
+    if( !loadIkWorkers(pool_size) )
+      return false;
+  }
+
+  // Make room for the solutions, only allocates the first time we see this many candidates
+  arena.reserve(num_candidates, joint_model_group->getVariableCount());
+  arena.clearIkTiers(first_id, num_candidates);
+
+  // Also when streaming, the solvers check it whenever racing is configured
+  if( hedge_settings_.num_seeds_ > 1 )
   {
-    kin_solvers_.clear();
+    hedge_solved_.assign(num_candidates, 0);
+    hedge_cpu_used_ = 0;
+    hedge_wins_.assign(SEED_CURRENT_STATE + 1, 0);
+    getCurrentState().copyJointGroupPositions(joint_model_group, current_state_seed_);
+  }
 
-    boost::shared_ptr<kinematics_plugin_loader::KinematicsPluginLoader> kin_plugin_loader;
-    kin_plugin_loader.reset(new kinematics_plugin_loader::KinematicsPluginLoader());
-    robot_model::SolverAllocatorFn kin_allocator = kin_plugin_loader->getLoaderFunction();
+  return true;
+}
 
-    const robot_model::JointModelGroup* joint_model_group = robot_model_->getJointModelGroup(planning_group_);
+// Give every worker a share of the candidates
+void GraspFilter::assignIkJobs(GraspArena& arena, std::size_t first_id, std::size_t end_id, int num_threads,
+  double timeout, boost::mutex* lock, bool streaming)
+{
+  int num_seeds = getNumSeeds(streaming);
 
-    // Create an ik solver for every thread
-    for (int i = 0; i < num_threads; ++i)
-    {
-      ROS_INFO_STREAM_NAMED("grasp","Creating ik solver " << i);
+  // Only the workers taking part measure their IK time
+  for (std::size_t i = 0; i < ik_workers_.size(); ++i)
+  {
+    ik_workers_[i].ik_time_ = 0;
+    ik_workers_[i].ik_calls_ = 0;
+  }
 
-      kin_solvers_.push_back(kin_allocator(joint_model_group));
+  // split up the work between threads
+  double num_grasps_per_thread = double(end_id - first_id) / num_threads;
+  //ROS_INFO_STREAM("total grasps " << num_grasps << " per thead: " << num_grasps_per_thread);
 
-      // Test to make sure we have a valid kinematics solver
-      if( !kin_solvers_[i] )
+  int grasps_id_start;
+  int grasps_id_end = first_id;
+
+  for(int i = 0; i < num_threads; ++i)
+  {
+    grasps_id_start = grasps_id_end;
+    grasps_id_end = first_id + ceil(num_grasps_per_thread*(i+1));
+    if( grasps_id_end >= int(end_id) )
+      grasps_id_end = end_id;
+    //ROS_INFO_STREAM_NAMED("grasp","low " << grasps_id_start << " high " << grasps_id_end);
+
+    // Every seed of a share works on the same grasps
+    for(int j = 0; j < num_seeds; ++j)
+    {
+      int worker_id = i * num_seeds + j;
+      ik_seed_t seed_type = j <= SEED_CURRENT_STATE ? ik_seed_t(j) : SEED_RANDOM;
+      IkThreadStruct& job = ik_workers_[worker_id].job_;
+      job = IkThreadStruct(&arena, grasps_id_start, grasps_id_end, timeout, lock, worker_id, seed_type);
+      if( streaming )
       {
-        ROS_ERROR_STREAM_NAMED("grasp_filter","No kinematic solver found");
-        return false;
+        job.candidate_queue_ = &candidate_queue_;
+        job.result_queue_ = &result_queue_;
       }
     }
   }
+}
+
+// Number of threads for a request
+int GraspFilter::chooseNumThreads(std::size_t num_grasps, double timeout) const
+{
+  int num_threads = getMaxThreads();
 
-  // Benchmark time
-  ros::Time start_time;
-  start_time = ros::Time::now();
+  // Leave the cores alone that other processes keep busy
+  if( concurrency_settings_.use_load_average_ )
   {
+    double load_average;
+    if( getloadavg(&load_average, 1) == 1 )
+      num_threads = std::min(num_threads, std::max(1, int(getNumCores() - load_average + 0.5)));
+  }
 
-    // -----------------------------------------------------------------------------------------------
-    // Loop through poses and find those that are kinematically feasible
-    std::vector<moveit_msgs::Grasp> filtered_grasps;
+  // Waking up a thread only pays off if it gets enough work. Until we have measured, assume every query
+  // runs to the timeout
+  double ik_latency = ik_latency_estimate_ > 0 ? ik_latency_estimate_ : timeout;
+  if( concurrency_settings_.min_work_per_thread_ > 0 )
+  {
+    double useful_threads = ceil(num_grasps * ik_latency / concurrency_settings_.min_work_per_thread_);
+    if( useful_threads < num_threads )
+      num_threads = int(useful_threads);
+  }
 
-    boost::thread_group bgroup; // create a group of threads
-    boost::mutex lock; // used for sharing the same data structures
+  if( num_threads > int(num_grasps) )
+    num_threads = num_grasps;
+  return std::max(1, num_threads);
+}
 
-    ROS_INFO_STREAM_NAMED("grasp", "Filtering possible grasps with " << num_threads << " threads");
+// Seeds raced per grasp
+int GraspFilter::getNumSeeds(bool streaming) const
+{
+  // Streamed candidates are not raced, every worker takes its own from the queue with the best seed it has
+  if( streaming )
+    return 1;
+  return std::max(1, hedge_settings_.num_seeds_);
+}
 
-    // split up the work between threads
-    double num_grasps_per_thread = double(possible_grasps.size()) / num_threads;
-    //ROS_INFO_STREAM("total grasps " << possible_grasps.size() << " per thead: " << num_grasps_per_thread);
+// Number of threads whose solvers are loaded
+int GraspFilter::getMaxThreads() const
+{
+  if( concurrency_settings_.max_threads_ > 0 )
+    return concurrency_settings_.max_threads_;
+  return getNumCores();
+}
 
-    int grasps_id_start;
-    int grasps_id_end = 0;
+// Number of cores the IK threads may use
+int GraspFilter::getNumCores() const
+{
+  if( !scheduling_settings_.cpu_set_.empty() )
+    return scheduling_settings_.cpu_set_.size();
+  return std::max(1, int(boost::thread::hardware_concurrency()));
+}
 
-    for(int i = 0; i < num_threads; ++i)
+// Read the worker scheduling from parameters
+bool GraspFilter::loadWorkerScheduling(const ros::NodeHandle& nh)
+{
+  WorkerSchedulingSettings settings = scheduling_settings_;
+  nh.getParam("cpu_set", settings.cpu_set_);
+  nh.getParam("pin_workers", settings.pin_workers_);
+  nh.getParam("priority", settings.priority_);
+
+  std::string policy;
+  if( nh.getParam("scheduling_policy", policy) )
+  {
+    if( policy == "other" )
+      settings.policy_ = SCHED_OTHER;
+    else if( policy == "batch" )
+      settings.policy_ = SCHED_BATCH;
+    else if( policy == "idle" )
+      settings.policy_ = SCHED_IDLE;
+    else if( policy == "fifo" )
+      settings.policy_ = SCHED_FIFO;
+    else if( policy == "rr" )
+      settings.policy_ = SCHED_RR;
+    else
     {
-      grasps_id_start = grasps_id_end;
-      grasps_id_end = ceil(num_grasps_per_thread*(i+1));
-      if( grasps_id_end >= possible_grasps.size() )
-        grasps_id_end = possible_grasps.size();
-      //ROS_INFO_STREAM_NAMED("grasp","low " << grasps_id_start << " high " << grasps_id_end);
+      ROS_ERROR_STREAM_NAMED("grasp_filter","Unknown scheduling policy " << policy);
+      return false;
+    }
+  }
+
+  for (std::size_t i = 0; i < settings.cpu_set_.size(); ++i)
+  {
+    if( settings.cpu_set_[i] < 0 || settings.cpu_set_[i] >= CPU_SETSIZE )
+    {
+      ROS_ERROR_STREAM_NAMED("grasp_filter","Invalid core " << settings.cpu_set_[i] << " in cpu_set");
+      return false;
+    }
+  }
+
+  setWorkerScheduling(settings);
+  return true;
+}
+
+// Apply the worker scheduling to the calling thread
+void GraspFilter::applyWorkerScheduling(int thread_id)
+{
+  const WorkerSchedulingSettings& settings = scheduling_settings_;
+
+  if( !settings.cpu_set_.empty() )
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if( settings.pin_workers_ )
+      CPU_SET(settings.cpu_set_[thread_id % settings.cpu_set_.size()], &cpu_set);
+    else
+      for (std::size_t i = 0; i < settings.cpu_set_.size(); ++i)
+        CPU_SET(settings.cpu_set_[i], &cpu_set);
+
+    if( pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0 )
+      ROS_WARN_STREAM_NAMED("grasp_filter","Unable to set the cpu affinity of ik thread " << thread_id);
+  }
+
+  if( settings.policy_ != SCHED_OTHER )
+  {
+    sched_param param;
+    param.sched_priority = ( settings.policy_ == SCHED_FIFO || settings.policy_ == SCHED_RR ) ? settings.priority_ : 0;
+    if( pthread_setschedparam(pthread_self(), settings.policy_, &param) != 0 )
+      ROS_WARN_STREAM_NAMED("grasp_filter","Unable to set the scheduling policy of ik thread " << thread_id
+                            << ", real-time policies need privileges");
+  }
+}
+
+// Run the jobs of the first num_workers workers
+void GraspFilter::runIkJobs(int num_workers)
+{
+  // A single job is not worth the context switches, unless the caller's thread may not run IK
+  if( num_workers == 1 && scheduling_settings_.cpu_set_.empty() && scheduling_settings_.policy_ == SCHED_OTHER )
+  {
+    filterGraspThread(ik_workers_[0]);
+    return;
+  }
+
+  startIkJobs(num_workers);
+  waitIkJobs();
+}
+
+// Wake up the workers on their jobs
+void GraspFilter::startIkJobs(int num_workers)
+{
+  boost::mutex::scoped_lock slock(workers_mutex_);
+  workers_running_ = num_workers;
+  workers_active_ = num_workers;
+  ++workers_job_count_;
+  for (int i = 0; i < num_workers; ++i)
+    ik_workers_[i].start_cond_->notify_one();
+}
+
+// Wait for the workers to finish their jobs
+void GraspFilter::waitIkJobs()
+{
+  GRASP_TRACE_SPAN("wait for ik threads");
+  boost::mutex::scoped_lock slock(workers_mutex_);
+  while( workers_running_ > 0 )
+    workers_done_cond_.wait(slock);
+}
+
+// Collect the solved candidates in candidate order and log the results of a request
+void GraspFilter::finishIkRequest(GraspArena& arena, std::size_t first_id, const Eigen::Affine3d* block_pose)
+{
+  GRASP_TRACE_SPAN("assemble");
+  ros::WallTime start_time = ros::WallTime::now();
+
+  // Learn how expensive IK is for the next choice of thread count
+  double ik_time = 0;
+  int ik_calls = 0;
+  for (std::size_t i = 0; i < ik_workers_.size(); ++i)
+  {
+    IkWorker& worker = ik_workers_[i];
+    ik_time += worker.ik_time_;
+    ik_calls += worker.ik_calls_;
+
+    // The workers did not touch the shared statistics while they ran
+    statistics_->mergeStage(STAGE_IK_CALL, worker.ik_call_histogram_);
+    worker.ik_call_histogram_.reset();
+    for (std::size_t j = 0; j < worker.ik_counts_.size(); ++j)
+    {
+      if( worker.ik_counts_[j] > 0 )
+        statistics_->addCount(grasp_counter_t(j), worker.ik_counts_[j]);
+      log_summary_.add(j, worker.ik_counts_[j]);
+      worker.ik_counts_[j] = 0;
+    }
+  }
+  if( ik_calls > 0 )
+  {
+    double weight = ik_latency_estimate_ > 0 ? concurrency_settings_.latency_smoothing_ : 1.0;
+    ik_latency_estimate_ = (1.0 - weight) * ik_latency_estimate_ + weight * ik_time / ik_calls;
+  }
+
+  // Threads finish in any order, the slots do not. Earlier passes only added smaller ids so the result stays sorted
+  ik_tier_solved_.assign(ik_tiers_.size(), 0);
+  const GraspCandidates& candidates = arena.getCandidates();
+  for (std::size_t i = first_id; i < candidates.size(); ++i)
+  {
+    int ik_tier = arena.getIkTier(i);
+    if( ik_tier < 0 )
+      continue;
+
+    arena.getFilteredIds().push_back(i);
+    ++ik_tier_solved_[ik_tier];
+
+    // Remember it for seeding future requests, in a fixed order so the database does not depend on thread timing
+    if( seed_database_ )
+      seed_database_->addSolution(planning_group_, candidates[i].grasp_pose_, arena.getSolution(i),
+                                  arena.getNumJoints());
+  }
+
+  // Learn which slots are feasible for blocks here. The candidates a cancelled request skipped were not infeasible
+  if( slot_history_ && block_pose && !cancelled_ )
+    slot_history_->addResults(*block_pose, arena, first_id);
+  statistics_->recordStage(STAGE_ASSEMBLE, (ros::WallTime::now() - start_time).toSec());
+
+  GRASP_LOG_DEBUG_STREAM("grasp", "Found " << arena.getFilteredIds().size() << " ik solutions out of " <<
+                         arena.getCandidates().size() );
+
+  if( ik_tiers_.size() > 1 )
+    for (std::size_t i = 0; i < ik_tiers_.size(); ++i)
+      GRASP_LOG_DEBUG_STREAM("grasp", "IK tier " << i << " solved " << ik_tier_solved_[i] << " grasps");
+
+  if( hedge_settings_.num_seeds_ > 1 )
+    GRASP_LOG_DEBUG_STREAM("grasp", "Seeds won: nearest " << hedge_wins_[SEED_NEAREST] << ", previous "
+                           << hedge_wins_[SEED_PREVIOUS] << ", random " << hedge_wins_[SEED_RANDOM]
+                           << ", current state " << hedge_wins_[SEED_CURRENT_STATE] << ", using "
+                           << hedge_cpu_used_ << " solver seconds");
+
+  // One line per period however many requests there were
+  log_summary_.add(SUMMARY_CANDIDATES, candidates.size() - first_id);
+  log_summary_.add(SUMMARY_FEASIBLE, arena.getFilteredIds().size());
+  if( log_summary_.addRequest() )
+  {
+    ROS_INFO_STREAM_NAMED("grasp", log_summary_.getRequests() << " requests in the last "
+                          << log_summary_.getDuration() << "s found " << log_summary_.getCount(SUMMARY_FEASIBLE)
+                          << " feasible grasps out of " << log_summary_.getCount(SUMMARY_CANDIDATES)
+                          << ". IK solved " << log_summary_.getCount(COUNT_IK_SUCCESS) << ", no solution "
+                          << log_summary_.getCount(COUNT_NO_IK_SOLUTION) << ", timed out "
+                          << log_summary_.getCount(COUNT_TIMED_OUT) << ", errors "
+                          << log_summary_.getCount(COUNT_IK_ERROR));
+    log_summary_.reset();
+  }
+}
+
+// Create a solver and a thread for each worker
+bool GraspFilter::loadIkWorkers(int num_threads)
+{
+  stopIkWorkers();
+
+  robot_model::SolverAllocatorFn kin_allocator = solver_allocator_;
+  boost::shared_ptr<kinematics_plugin_loader::KinematicsPluginLoader> kin_plugin_loader;
+  if( !kin_allocator )
+  {
+    kin_plugin_loader.reset(new kinematics_plugin_loader::KinematicsPluginLoader());
+    kin_allocator = kin_plugin_loader->getLoaderFunction();
+  }
+
+  const robot_model::JointModelGroup* joint_model_group = robot_model_->getJointModelGroup(planning_group_);
+
+  // Create an ik solver of every tier for every thread
+  ik_tiers_changed_ = false;
+  pool_changed_ = false;
+  ik_workers_.resize(num_threads);
+  for (int i = 0; i < num_threads; ++i)
+  {
+    GRASP_LOG_DEBUG_STREAM("grasp","Creating ik solver " << i);
 
-      IkThreadStruct tc(possible_grasps, filtered_grasps, grasps_id_start, grasps_id_end,
-                        kin_solvers_[i], timeout, &lock, i);
-      bgroup.create_thread( boost::bind( &GraspFilter::filterGraspThread, this, tc ) );
+    // One default solver per worker, whatever the number of tiers
+    kinematics::KinematicsBasePtr default_solver = kin_allocator(joint_model_group);
+    if( !default_solver )
+    {
+      ROS_ERROR_STREAM_NAMED("grasp_filter","No kinematic solver found for group " << planning_group_);
+      ik_workers_.clear();
+      return false;
     }
 
-    ROS_INFO_STREAM_NAMED("grasp","Waiting to joint threads...");
-    bgroup.join_all(); // wait for all threads to finish
-    ROS_INFO_STREAM_NAMED("grasp","Done waiting to joint threads...");
+    ik_workers_[i].kin_solvers_.resize(ik_tiers_.size());
+    for (std::size_t j = 0; j < ik_tiers_.size(); ++j)
+    {
+      ik_workers_[i].kin_solvers_[j] = loadIkSolver(ik_tiers_[j], default_solver);
 
-    ROS_INFO_STREAM_NAMED("grasp", "Found " << filtered_grasps.size() << " ik solutions out of " <<
-                          possible_grasps.size() );
+      // Test to make sure we have a valid kinematics solver
+      if( !ik_workers_[i].kin_solvers_[j] )
+      {
+        ROS_ERROR_STREAM_NAMED("grasp_filter","No kinematic solver found for IK tier " << j);
+        ik_workers_.clear();
+        return false;
+      }
+    }
 
-    possible_grasps = filtered_grasps;
+    // Allocate the buffers once
+    ik_workers_[i].ik_seed_state_.resize(joint_model_group->getVariableCount());
+    ik_workers_[i].solution_.reserve(joint_model_group->getVariableCount());
 
+    // Random seeds are repeatable between runs
+    ik_workers_[i].rng_.reset(new random_numbers::RandomNumberGenerator(i));
+    ik_workers_[i].start_cond_.reset(new boost::condition_variable());
   }
-  // End Benchmark time
-  double duration = (ros::Time::now() - start_time).toNSec() * 1e-6;
-  ROS_INFO_STREAM_NAMED("grasp","Grasp generator IK grasp filtering benchmark time:");
-  std::cout << duration << "\t" << possible_grasps.size() << "\n";
 
-  ROS_INFO_STREAM_NAMED("grasp","Possible grasps filtered to " << possible_grasps.size() << " options.");
+  // Start the threads only once the vector is complete, they keep references into it
+  unsigned long job_count;
+  {
+    boost::mutex::scoped_lock slock(workers_mutex_);
+    workers_shutdown_ = false;
+    job_count = workers_job_count_;
+  }
+  for (int i = 0; i < num_threads; ++i)
+    ik_workers_[i].thread_.reset(new boost::thread(boost::bind(&GraspFilter::ikWorkerThread, this, i, job_count)));
 
   return true;
 }
 
+// The planning scene's current state, or the default state without a planning scene
+const robot_state::RobotState& GraspFilter::getCurrentState() const
+{
+  if( visual_tools_ )
+    return visual_tools_->getPlanningSceneMonitor()->getPlanningScene()->getCurrentState();
+  return *default_state_;
+}
+
+// Create the solver of one tier
+kinematics::KinematicsBasePtr GraspFilter::loadIkSolver(const IkTier& ik_tier,
+  const kinematics::KinematicsBasePtr& default_solver)
+{
+  if( ik_tier.plugin_name_.empty() )
+    return default_solver;
+
+  kinematics::KinematicsBasePtr kin_solver;
+  try
+  {
+    if( !kin_class_loader_ )
+      kin_class_loader_.reset(new pluginlib::ClassLoader<kinematics::KinematicsBase>("moveit_core",
+                                                                                    "kinematics::KinematicsBase"));
+    kin_solver = kin_class_loader_->createInstance(ik_tier.plugin_name_);
+  }
+  catch(pluginlib::PluginlibException& ex)
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter","Unable to load kinematics plugin " << ik_tier.plugin_name_
+                           << ": " << ex.what());
+    return kinematics::KinematicsBasePtr();
+  }
+
+  if( !kin_solver->initialize("robot_description", planning_group_, default_solver->getBaseFrame(),
+                              default_solver->getTipFrame(), default_solver->getSearchDiscretization()) )
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter","Unable to initialize kinematics plugin " << ik_tier.plugin_name_);
+    return kinematics::KinematicsBasePtr();
+  }
+
+  return kin_solver;
+}
+
+// Stop and join all worker threads
+void GraspFilter::stopIkWorkers()
+{
+  {
+    boost::mutex::scoped_lock slock(workers_mutex_);
+    workers_shutdown_ = true;
+    for (std::size_t i = 0; i < ik_workers_.size(); ++i)
+      if( ik_workers_[i].start_cond_ )
+        ik_workers_[i].start_cond_->notify_one();
+  }
+  for (std::size_t i = 0; i < ik_workers_.size(); ++i)
+    if( ik_workers_[i].thread_ )
+      ik_workers_[i].thread_->join();
+  ik_workers_.clear();
+}
+
+// Main loop of a worker thread
+void GraspFilter::ikWorkerThread(int thread_id, unsigned long last_job_count)
+{
+  applyWorkerScheduling(thread_id);
+
+  std::stringstream thread_name;
+  thread_name << "ik worker " << thread_id;
+  GraspTracer::setThreadName(thread_name.str());
+
+  while(true)
+  {
+    // Wait for the next request
+    {
+      boost::mutex::scoped_lock slock(workers_mutex_);
+      while( ( workers_job_count_ == last_job_count || std::size_t(thread_id) >= workers_active_ ) && !workers_shutdown_ )
+        ik_workers_[thread_id].start_cond_->wait(slock);
+      if( workers_shutdown_ )
+        return;
+      last_job_count = workers_job_count_;
+    }
+
+    filterGraspThread(ik_workers_[thread_id]);
+
+    {
+      boost::mutex::scoped_lock slock(workers_mutex_);
+      if( --workers_running_ == 0 )
+      {
+        // No more feasible grasps will be streamed
+        if( ik_workers_[thread_id].job_.result_queue_ )
+          ik_workers_[thread_id].job_.result_queue_->close();
+        workers_done_cond_.notify_all();
+      }
+    }
+  }
+}
+
 // Thread for checking part of the possible grasps list
-void GraspFilter::filterGraspThread(IkThreadStruct ik_thread_struct)
+void GraspFilter::filterGraspThread(IkWorker& worker)
 {
-  // Seed state - start at zero
-  std::vector<double> ik_seed_state(7); // fill with zeros
+  GRASP_TRACE_SPAN("ik job");
+  IkThreadStruct& ik_thread_struct = worker.job_;
+  GraspArena& arena = *ik_thread_struct.arena_;
+  const bool hedged = hedge_settings_.num_seeds_ > 1 && !ik_thread_struct.candidate_queue_;
 
-  std::vector<double> solution;
-  moveit_msgs::MoveItErrorCodes error_code;
-  geometry_msgs::Pose* ik_pose;
+  // Seed state - start at zero unless the database knows a closer pose
+  std::vector<double>& ik_seed_state = worker.ik_seed_state_;
+  std::fill(ik_seed_state.begin(), ik_seed_state.end(), 0.0);
 
-  // Process the assigned grasps
-  for( int i = ik_thread_struct.grasps_id_start_; i < ik_thread_struct.grasps_id_end_; ++i )
+  std::vector<double>& solution = worker.solution_;
+  moveit_msgs::MoveItErrorCodes& error_code = worker.error_code_;
+  geometry_msgs::Pose ik_pose_msg;
+  geometry_msgs::Pose* ik_pose = &ik_pose_msg;
+
+  // Process the assigned grasps, or the streamed ones
+  int next_id = ik_thread_struct.grasps_id_start_;
+  double reserved_cpu = 0; // of the hedge CPU budget, for the query about to run
+  while( true )
   {
-    ROS_DEBUG_STREAM_NAMED("grasp", "Checking grasp #" << i);
+    int i;
+    if( ik_thread_struct.candidate_queue_ )
+    {
+      std::size_t streamed_id;
+      if( !ik_thread_struct.candidate_queue_->pop(streamed_id) )
+        break;
+      i = streamed_id;
+    }
+    else if( next_id < ik_thread_struct.grasps_id_end_ )
+      i = next_id++;
+    else
+      break;
+
+    // Keep taking streamed candidates so the generating thread never blocks on a full queue
+    if( cancelled_ )
+      continue;
 
-    // Pointer to current pose
-    ik_pose = &ik_thread_struct.possible_grasps_[i].grasp_pose.pose;
+    GRASP_LOG_GRASP_STREAM("grasp", "Checking grasp #" << i);
 
-    
-    ROS_WARN_STREAM_NAMED("temp","ik_pose" << *ik_pose);
-    std::copy(ik_seed_state.begin(), ik_seed_state.end(), std::ostream_iterator<double>(std::cout, "\n"));      
-    ROS_WARN_STREAM_NAMED("temp","timeout" << ik_thread_struct.timeout_);
-    std::copy(solution.begin(), solution.end(), std::ostream_iterator<double>(std::cout, "\n"));      
-    ROS_WARN_STREAM_NAMED("temp","error_code" << error_code);
+    if( hedged )
+    {
+      boost::mutex::scoped_lock slock(*ik_thread_struct.lock_);
 
+      // Another seed was faster
+      if( hedge_solved_[i] )
+        continue;
+
+      // Out of CPU time, leave the rest to the primary seed. The other seeds only start a query whose timeout
+      // still fits the budget, and hold on to that time until the query is done
+      if( ik_thread_struct.seed_type_ != SEED_NEAREST && hedge_settings_.cpu_budget_ > 0 )
+      {
+        if( hedge_cpu_used_ + ik_thread_struct.timeout_ > hedge_settings_.cpu_budget_ )
+          break;
+        hedge_cpu_used_ += ik_thread_struct.timeout_;
+        reserved_cpu = ik_thread_struct.timeout_;
+      }
+    }
+
+    // Current pose
+    const Eigen::Affine3d& grasp_pose = arena.getCandidates()[i].grasp_pose_;
+    tf::poseEigenToMsg(grasp_pose, ik_pose_msg);
+
+    chooseSeed(worker, i, grasp_pose);
+
+    GRASP_LOG_GRASP_STREAM("grasp", "Grasp #" << i << " ik pose " << ik_pose->position.x << " "
+                           << ik_pose->position.y << " " << ik_pose->position.z << ", seed "
+                           << LogJoints(ik_seed_state) << ", timeout " << ik_thread_struct.timeout_);
 
     // Test it with IK
-    ik_thread_struct.kin_solver_->
-      searchPositionIK(*ik_pose, ik_seed_state, ik_thread_struct.timeout_, solution, error_code);
+    ros::WallTime ik_start_time = ros::WallTime::now();
+    int ik_tier;
+    {
+      GRASP_TRACE_SPAN_ARG("ik call", "candidate", i);
+      ik_tier = searchIk(worker, i, *ik_pose);
+    }
+    if( reserved_cpu > 0 )
+    {
+      boost::mutex::scoped_lock slock(*ik_thread_struct.lock_);
+      hedge_cpu_used_ -= reserved_cpu;
+      reserved_cpu = 0;
+    }
+    double ik_time = (ros::WallTime::now() - ik_start_time).toSec();
+    worker.ik_time_ += ik_time;
+    ++worker.ik_calls_;
+    worker.ik_call_histogram_.record(ik_time);
 
     // Results
-    if( error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS )
+    if( ik_tier >= 0 )
     {
-      ROS_INFO_STREAM_NAMED("grasp","Found IK Solution");
-
-      // Copy solution to seed state so that next solution is faster
-      ik_seed_state = solution;
+      ++worker.ik_counts_[COUNT_IK_SUCCESS];
 
-      // Copy solution to manipulation_msg so that we can use it later
-      // Note: doesn't actually belong here TODO: fix this hack
-      //ik_thread_struct.possible_grasps_[i].grasp_posture.position = solution;
-
-      // Lock the result vector so we can add to it for a second
+      // Two seeds can succeed at once, only the first counts
+      if( hedged )
       {
         boost::mutex::scoped_lock slock(*ik_thread_struct.lock_);
-        ik_thread_struct.filtered_grasps_.push_back( ik_thread_struct.possible_grasps_[i] );
+        if( hedge_solved_[i] )
+          continue;
+        hedge_solved_[i] = 1;
+        ++hedge_wins_[ik_thread_struct.seed_type_];
       }
 
+      // Copy solution to the candidate's own slot in the arena, no other thread writes it
+      std::copy(solution.begin(), solution.end(), arena.getSolution(i));
+      arena.setIkTier(i, ik_tier);
+
+      // Hand it to the caller right away
+      if( ik_thread_struct.result_queue_ )
+        ik_thread_struct.result_queue_->push(i);
+
+      GRASP_LOG_GRASP_STREAM("grasp", "Grasp #" << i << " solved by tier " << ik_tier << ": "
+                             << LogJoints(solution));
+
+      // Copy solution to seed state so that next solution is faster
+      std::copy(solution.begin(), solution.end(), ik_seed_state.begin());
+
       // TODO: is this thread safe? (prob not)
       if(rviz_verbose_)
         visual_tools_->publishArrow(*ik_pose);
     }
     else if( error_code.val == moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION )
-      ROS_INFO_STREAM_NAMED("grasp","Unable to find IK solution for pose.");
+    {
+      ++worker.ik_counts_[COUNT_NO_IK_SOLUTION];
+      GRASP_LOG_GRASP_STREAM("grasp", "Grasp #" << i << " has no IK solution");
+    }
     else if( error_code.val == moveit_msgs::MoveItErrorCodes::TIMED_OUT )
     {
-      //ROS_INFO_STREAM_NAMED("grasp","Unable to find IK solution for pose: Timed Out.");
-      //std::copy(solution.begin(),solution.end(), std::ostream_iterator<double>(std::cout, "\n"));
+      ++worker.ik_counts_[COUNT_TIMED_OUT];
+      GRASP_LOG_GRASP_STREAM("grasp", "Grasp #" << i << " timed out");
     }
     else
-      ROS_INFO_STREAM_NAMED("grasp","IK solution error: MoveItErrorCodes.msg = " << error_code);
+    {
+      ++worker.ik_counts_[COUNT_IK_ERROR];
+      GRASP_LOG_GRASP_STREAM("grasp", "Grasp #" << i << " IK error " << error_code.val);
+    }
+  }
+
+  GRASP_LOG_DEBUG_STREAM("grasp","Thread " << ik_thread_struct.thread_id_ << " finished");
+}
+
+// Fill the worker's seed state according to its seed type
+void GraspFilter::chooseSeed(IkWorker& worker, std::size_t candidate, const Eigen::Affine3d& grasp_pose)
+{
+  std::vector<double>& ik_seed_state = worker.ik_seed_state_;
+
+  switch( worker.job_.seed_type_ )
+  {
+    case SEED_NEAREST:
+      // A tracked grasp is best seeded with its own solution from the last update
+      if( candidate < arena_seeded_end_ )
+      {
+        const double* solution = worker.job_.arena_->getSolution(candidate);
+        std::copy(solution, solution + ik_seed_state.size(), ik_seed_state.begin());
+        ++worker.ik_counts_[COUNT_SEED_CACHE_HIT];
+        break;
+      }
+
+      // Start from the solution of the closest pose solved before, otherwise from our previous solution
+      if( seed_database_ )
+      {
+        if( seed_database_->findSeed(planning_group_, grasp_pose, ik_seed_state) )
+          ++worker.ik_counts_[COUNT_SEED_CACHE_HIT];
+        else
+          ++worker.ik_counts_[COUNT_SEED_CACHE_MISS];
+      }
+      break;
+    case SEED_PREVIOUS:
+      break;
+    case SEED_RANDOM:
+      robot_model_->getJointModelGroup(planning_group_)->getVariableRandomPositions(*worker.rng_, ik_seed_state);
+      break;
+    case SEED_CURRENT_STATE:
+      if( current_state_seed_.size() == ik_seed_state.size() )
+        std::copy(current_state_seed_.begin(), current_state_seed_.end(), ik_seed_state.begin());
+      break;
   }
+}
 
-  ROS_INFO_STREAM_NAMED("grasp","Thread " << ik_thread_struct.thread_id_ << " finished");
+// Run IK for one candidate through the tiers
+int GraspFilter::searchIk(IkWorker& worker, std::size_t candidate, const geometry_msgs::Pose& ik_pose)
+{
+  for (std::size_t tier = 0; tier < worker.kin_solvers_.size(); ++tier)
+  {
+    if( searchIkTier(worker, candidate, ik_pose, tier) )
+      return tier;
+
+    // No point in falling back if another seed has won meanwhile
+    if( hedge_settings_.num_seeds_ > 1 )
+    {
+      boost::mutex::scoped_lock slock(*worker.job_.lock_);
+      if( hedge_solved_[candidate] )
+        break;
+    }
+  }
+  return -1;
 }
 
+// Run one tier's solver
+bool GraspFilter::searchIkTier(IkWorker& worker, std::size_t candidate, const geometry_msgs::Pose& ik_pose,
+                               int tier)
+{
+  const IkThreadStruct& ik_thread_struct = worker.job_;
+  const kinematics::KinematicsBasePtr& kin_solver = worker.kin_solvers_[tier];
+  double timeout = ik_tiers_[tier].timeout_ > 0 ? ik_tiers_[tier].timeout_ : ik_thread_struct.timeout_;
+
+  // Tiers with their own timeout are left alone
+  const Eigen::Affine3d& grasp_pose = ik_thread_struct.arena_->getCandidates()[candidate].grasp_pose_;
+  bool learn_timeout = ik_tiers_[tier].timeout_ <= 0 && timeout_model_;
+  if( learn_timeout )
+    timeout = timeout_model_->getTimeout(planning_group_, grasp_pose, timeout);
+
+  // Every seed gets the full timeout. Restarting a solver from the same seed in shorter searches would only
+  // repeat the start of its search, so a seed that loses the race stops at its next tier or candidate instead
+  ros::WallTime start_time = ros::WallTime::now();
+  kin_solver->searchPositionIK(ik_pose, worker.ik_seed_state_, timeout, worker.solution_, worker.error_code_);
+  bool found = worker.error_code_.val == moveit_msgs::MoveItErrorCodes::SUCCESS;
+  double solve_time = (ros::WallTime::now() - start_time).toSec();
+
+  bool lost = false;
+  if( hedge_settings_.num_seeds_ > 1 )
+  {
+    boost::mutex::scoped_lock slock(*ik_thread_struct.lock_);
+    lost = hedge_solved_[candidate];
+    hedge_cpu_used_ += solve_time;
+  }
+
+  // A seed that lost the race says nothing about how hard the pose is
+  if( learn_timeout && !lost )
+    timeout_model_->addQuery(planning_group_, grasp_pose, solve_time, found);
+  return found;
+}
 
 } // namespace
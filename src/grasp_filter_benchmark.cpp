@@ -0,0 +1,294 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman
+   Desc:   Benchmarks how the grasp filter scales with threads and candidates, without a robot's MoveIt config.
+           A synthetic 7 joint arm is solved by MockKinematics, whose latency and success rate are fixed below.
+           Reports throughput, p50/p99 request latency and scaling efficiency relative to one thread as CSV:
+
+             rosrun block_grasp_generator grasp_filter_benchmark [output.csv]
+*/
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_model/robot_model.h>
+
+// Grasp generation and filtering
+#include <block_grasp_generator/grasp_generator_core.h>
+#include <block_grasp_generator/grasp_filter.h>
+#include <block_grasp_generator/mock_kinematics.h>
+#include "benchmark_utils.h"
+
+// Baxter specific properties
+#include <block_grasp_generator/baxter_data.h>
+#include <block_grasp_generator/custom_environment2.h>
+
+// C++
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace baxter_pick_place
+{
+
+static const std::string PLANNING_GROUP = "arm";
+static const std::size_t NUM_JOINTS = 7;
+static const unsigned int WORKLOAD_SEED = 42;
+static const std::size_t NUM_REQUESTS = 10; // per thread and candidate count, after one warm up request
+static const std::size_t CANDIDATE_COUNTS[] = { 64, 256, 1024 };
+
+/**
+ * \brief Request latencies of one thread and candidate count
+ */
+struct ScalingResult
+{
+  int num_threads_;
+  std::size_t num_candidates_;
+  std::size_t num_feasible_; // of the last request
+  double total_seconds_;
+  double p50_seconds_;
+  double p99_seconds_;
+};
+
+class GraspFilterBenchmark
+{
+private:
+
+  robot_model::RobotModelConstPtr robot_model_;
+  block_grasp_generator::GraspFilterPtr grasp_filter_;
+  block_grasp_generator::MockKinematicsSettings mock_settings_;
+
+  // the workload, same on every run
+  block_grasp_generator::GraspCandidates candidates_;
+
+  std::vector<ScalingResult> results_;
+
+public:
+
+  // Constructor
+  GraspFilterBenchmark()
+  {
+    // A query takes about a millisecond and fails fast, like a good analytic solver
+    mock_settings_.latency_median_ = 0.001;
+    mock_settings_.latency_sigma_ = 0.5;
+    mock_settings_.success_rate_ = 0.5;
+    mock_settings_.timeout_behavior_ = block_grasp_generator::MOCK_FAIL_FAST;
+    mock_settings_.seed_ = WORKLOAD_SEED;
+  }
+
+  /**
+   * \brief Build the arm and the filter
+   */
+  bool load()
+  {
+    robot_model_ = block_grasp_generator::loadChainRobotModel(BASE_LINK, PLANNING_GROUP, NUM_JOINTS);
+    if( !robot_model_ )
+      return false;
+
+    grasp_filter_.reset(new block_grasp_generator::GraspFilter(BASE_LINK, robot_model_, PLANNING_GROUP));
+    grasp_filter_->setSolverAllocator(block_grasp_generator::MockKinematics::getAllocator(mock_settings_));
+
+    // Seeding does not change the mock's latency, leave it out of the measurement
+    grasp_filter_->setSeedDatabase(block_grasp_generator::IkSeedDatabasePtr());
+
+    // Every request should see the same timeouts, whatever the requests before it learned
+    grasp_filter_->setTimeoutModel(block_grasp_generator::IkTimeoutModelPtr());
+
+    generateCandidates();
+    return true;
+  }
+
+  /**
+   * \brief Candidates of blocks spread uniformly over the table, enough for the largest candidate count
+   */
+  void generateCandidates()
+  {
+    boost::random::mt19937 rng(WORKLOAD_SEED);
+    double x_min, x_max, y_min, y_max;
+    getTableDepthRange(x_min, x_max);
+    getTableWidthRange(y_min, y_max);
+    boost::random::uniform_real_distribution<double> x_dist(x_min, x_max);
+    boost::random::uniform_real_distribution<double> y_dist(y_min, y_max);
+    boost::random::uniform_real_distribution<double> angle_dist(0, M_PI);
+
+    block_grasp_generator::GraspGeneratorCore generator_core;
+    block_grasp_generator::GraspGeometry geometry;
+    std::size_t max_candidates = *std::max_element(CANDIDATE_COUNTS, CANDIDATE_COUNTS +
+                                                   sizeof(CANDIDATE_COUNTS) / sizeof(CANDIDATE_COUNTS[0]));
+    for (uint32_t request_id = 0; candidates_.size() < max_candidates; ++request_id)
+    {
+      Eigen::Affine3d block_pose = Eigen::Translation3d(x_dist(rng), y_dist(rng), 0) *
+        Eigen::AngleAxisd(angle_dist(rng), Eigen::Vector3d::UnitZ());
+      generator_core.generateGrasps(block_pose, geometry, request_id, candidates_);
+    }
+  }
+
+  /**
+   * \brief Every candidate count with every thread count from one up to the number of cores
+   */
+  void run()
+  {
+    std::vector<int> thread_counts;
+    int num_cores = std::max(1, int(boost::thread::hardware_concurrency()));
+    for (int num_threads = 1; num_threads < num_cores; num_threads *= 2)
+      thread_counts.push_back(num_threads);
+    thread_counts.push_back(num_cores);
+
+    for (std::size_t i = 0; i < sizeof(CANDIDATE_COUNTS) / sizeof(CANDIDATE_COUNTS[0]); ++i)
+      for (std::size_t j = 0; j < thread_counts.size(); ++j)
+        benchmarkFilter(thread_counts[j], CANDIDATE_COUNTS[i]);
+  }
+
+  /**
+   * \brief Time filterGrasps() with exactly num_threads threads
+   */
+  void benchmarkFilter(int num_threads, std::size_t num_candidates)
+  {
+    block_grasp_generator::ConcurrencySettings concurrency_settings;
+    concurrency_settings.max_threads_ = num_threads;
+    concurrency_settings.min_work_per_thread_ = 0;
+    concurrency_settings.use_load_average_ = false;
+    grasp_filter_->setConcurrencySettings(concurrency_settings);
+
+    block_grasp_generator::GraspCandidates candidates;
+    std::vector<double> latencies;
+    ScalingResult result;
+    result.num_threads_ = num_threads;
+    result.num_candidates_ = num_candidates;
+    result.total_seconds_ = 0;
+
+    // The first request starts the threads
+    for (std::size_t i = 0; i <= NUM_REQUESTS; ++i)
+    {
+      candidates.assign(candidates_.begin(), candidates_.begin() + num_candidates);
+
+      ros::WallTime start_time = ros::WallTime::now();
+      grasp_filter_->filterGrasps(candidates);
+      double latency = (ros::WallTime::now() - start_time).toSec();
+
+      if( i == 0 )
+        continue;
+      latencies.push_back(latency);
+      result.total_seconds_ += latency;
+    }
+    result.num_feasible_ = candidates.size();
+
+    std::sort(latencies.begin(), latencies.end());
+    result.p50_seconds_ = getPercentile(latencies, 0.5);
+    result.p99_seconds_ = getPercentile(latencies, 0.99);
+    results_.push_back(result);
+
+    ROS_INFO_STREAM_NAMED("benchmark", num_candidates << " candidates on " << num_threads << " threads: "
+                          << num_candidates * NUM_REQUESTS / result.total_seconds_ << " candidates/s");
+  }
+
+  /**
+   * \brief Nearest rank percentile of sorted values
+   */
+  static double getPercentile(const std::vector<double>& sorted, double percentile)
+  {
+    if( sorted.empty() )
+      return 0;
+    std::size_t rank = std::size_t(ceil(percentile * sorted.size()));
+    return sorted[std::max<std::size_t>(rank, 1) - 1];
+  }
+
+  /**
+   * \brief One line per candidate and thread count. Efficiency is the speedup over one thread per thread
+   */
+  void writeResults(std::ostream& out) const
+  {
+    out << "threads,candidates,feasible,requests,candidates_per_s,p50_ms,p99_ms,speedup,efficiency" << std::endl;
+    for (std::size_t i = 0; i < results_.size(); ++i)
+    {
+      const ScalingResult& result = results_[i];
+      double throughput = result.num_candidates_ * NUM_REQUESTS / result.total_seconds_;
+
+      double speedup = 0;
+      for (std::size_t j = 0; j < results_.size(); ++j)
+        if( results_[j].num_threads_ == 1 && results_[j].num_candidates_ == result.num_candidates_ )
+          speedup = results_[j].total_seconds_ / result.total_seconds_;
+
+      out << result.num_threads_ << ","
+          << result.num_candidates_ << ","
+          << result.num_feasible_ << ","
+          << NUM_REQUESTS << ","
+          << throughput << ","
+          << result.p50_seconds_ * 1e3 << ","
+          << result.p99_seconds_ * 1e3 << ","
+          << speedup << ","
+          << speedup / result.num_threads_ << std::endl;
+    }
+  }
+
+}; // end of class
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+  ros::init(argc, argv, "grasp_filter_benchmark", ros::init_options::AnonymousName);
+
+  // The filter's per request and per grasp log lines would be part of the measurement
+  const char* filter_loggers[] = { ".grasp", ".grasp_filter", ".temp" };
+  for (std::size_t i = 0; i < sizeof(filter_loggers) / sizeof(filter_loggers[0]); ++i)
+    ros::console::set_logger_level(std::string(ROSCONSOLE_DEFAULT_NAME) + filter_loggers[i],
+                                   ros::console::levels::Error);
+  ros::console::notifyLoggerLevelsChanged();
+
+  baxter_pick_place::GraspFilterBenchmark benchmark;
+  if( !benchmark.load() )
+    return 1;
+  benchmark.run();
+
+  if( argc > 1 )
+  {
+    std::ofstream file(argv[1]);
+    if( !file )
+    {
+      ROS_ERROR_STREAM_NAMED("benchmark","Unable to write " << argv[1]);
+      return 1;
+    }
+    benchmark.writeResults(file);
+  }
+  else
+    benchmark.writeResults(std::cout);
+
+  return 0;
+}
@@ -111,10 +111,11 @@ public:
 
   // Constructor
   GraspGeneratorTest(int num_tests) 
-    : nh_("~"),
-      arm_("right"),
-      planning_group_name_(arm_+"_arm")
+    : nh_("~")
   {
+    // Which arm to test, e.g. _arm:=left
+    nh_.param("arm", arm_, std::string("right"));
+    planning_group_name_ = arm_ + "_arm";
 
     // ---------------------------------------------------------------------------------------------
     // Load the Robot Viz Tools for publishing to Rviz
@@ -139,6 +140,7 @@ public:
     // Generate grasps for a bunch of random blocks
 
     geometry_msgs::Pose block_pose;
+    block_grasp_generator::GraspCandidates candidates;
     std::vector<moveit_msgs::Grasp> possible_grasps;
 
     // Loop
@@ -150,15 +152,19 @@ public:
       //getTestBlock(block_pose);
       visual_tools_->publishBlock(block_pose, BLOCK_SIZE, false);
 
+      candidates.clear();
       possible_grasps.clear();
 
       // Generate set of grasps for one block
       //visual_tools_->setMuted(true); // we don't want to see unfiltered grasps
-      block_grasp_generator_->generateGrasps( block_pose, grasp_data_, possible_grasps);
+      block_grasp_generator_->generateGrasps( block_pose, grasp_data_, candidates);
       visual_tools_->setMuted(false);
 
       // Filter the grasp for only the ones that are reachable
-      grasp_filter_->filterGrasps(possible_grasps);
+      grasp_filter_->filterGrasps(candidates);
+
+      // Only convert the survivors to messages
+      block_grasp_generator::BlockGraspGenerator::convertGrasps(candidates, grasp_data_, possible_grasps);
 
       // Visualize them
       block_grasp_generator_->visualizeGrasps(possible_grasps, block_pose, grasp_data_);
@@ -0,0 +1,408 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <block_grasp_generator/grasp_generator_core.h>
+
+#include <algorithm>
+
+namespace block_grasp_generator
+{
+
+// Constructor
+GraspGeneratorCore::GraspGeneratorCore()
+{
+}
+
+// Deconstructor
+GraspGeneratorCore::~GraspGeneratorCore()
+{
+}
+
+// Create all possible grasp positions for a block
+bool GraspGeneratorCore::generateGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+  uint32_t request_id, GraspCandidates& candidates) const
+{
+  // The ids would wrap around and stop telling grasps apart
+  if( geometry.angle_resolution_ < 1 || geometry.angle_resolution_ > GraspId::MAX_ANGLE_RESOLUTION )
+    return false;
+
+  // ---------------------------------------------------------------------------------------------
+  // Calculate grasps in two axis in both directions
+  generateAxisGrasps( block_pose, X_AXIS, DOWN, geometry, request_id, candidates); // got no grasps with this alone
+  generateAxisGrasps( block_pose, X_AXIS, UP,   geometry, request_id, candidates); // gives some grasps... looks ugly
+  generateAxisGrasps( block_pose, Y_AXIS, DOWN, geometry, request_id, candidates); // GOOD ONES!
+  generateAxisGrasps( block_pose, Y_AXIS, UP,   geometry, request_id, candidates); // gave a grasp from top... bad
+
+  return true;
+}
+
+// Number of candidates generateGrasps() creates
+std::size_t GraspGeneratorCore::getNumGrasps(const GraspGeometry& geometry)
+{
+  // 4 axis/direction sweeps, 2 approaches per angle
+  return 4 * (geometry.angle_resolution_ + 1) * 2;
+}
+
+// Create grasp positions in one axis
+bool GraspGeneratorCore::generateAxisGrasps(const Eigen::Affine3d& block_pose, grasp_axis_t axis,
+  grasp_direction_t direction, const GraspGeometry& geometry, uint32_t request_id, GraspCandidates& candidates) const
+{
+  /* Developer Note:
+   * Create angles 180 degrees around the chosen axis at given resolution
+   * We create the grasps in the reference frame of the block, then later convert it to the base link
+   */
+  for(int i = 0; i <= geometry.angle_resolution_; ++i)
+  {
+    if( !generateAngleGrasps(block_pose, axis, direction, i, geometry.angle_resolution_, geometry, request_id,
+                             candidates) )
+      return false;
+  }
+
+  return true;
+}
+
+// Create the candidates of a single angle of a sweep
+bool GraspGeneratorCore::generateAngleGrasps(const Eigen::Affine3d& block_pose, grasp_axis_t axis,
+  grasp_direction_t direction, int angle_index, int angle_resolution, const GraspGeometry& geometry,
+  uint32_t request_id, GraspCandidates& candidates) const
+{
+  if( angle_resolution < 1 || angle_resolution > GraspId::MAX_ANGLE_RESOLUTION )
+    return false;
+
+  double theta1 = angle_index * M_PI / angle_resolution; // Where the point is located around the block
+
+  Eigen::Affine3d grasp_pose;
+  if( !computeBlockGraspPose(axis, direction, theta1, geometry.grasp_depth_, grasp_pose) )
+    return false;
+
+  GraspCandidate candidate;
+  candidate.axis_ = axis;
+  candidate.direction_ = direction;
+  candidate.angle_index_ = angle_index;
+  candidate.grasp_quality_ = scoreGrasp(theta1);
+
+  // Change grasp to frame of reference of this custom end effector, then to the global frame (base_link)
+  candidate.grasp_pose_ = block_pose * grasp_pose * geometry.grasp_pose_to_eef_pose_;
+
+  // One candidate for each way of approaching the block
+  candidate.approach_ = APPROACH_BASE_FRAME;
+  candidate.id_ = GraspId(request_id, axis, direction, angle_index, angle_resolution, candidate.approach_);
+  candidate.canonical_id_ = candidate.id_;
+  candidates.push_back(candidate);
+
+  candidate.approach_ = APPROACH_EEF_FRAME;
+  candidate.id_ = GraspId(request_id, axis, direction, angle_index, angle_resolution, candidate.approach_);
+  candidate.canonical_id_ = candidate.id_;
+  candidates.push_back(candidate);
+
+  return true;
+}
+
+// Coarse-to-fine sampling around the parents
+std::size_t GraspGeneratorCore::refineGrasps(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+  uint32_t request_id, const GraspCandidates& parents, GraspCandidates& candidates, GraspScratch* scratch) const
+{
+  GraspScratch local_scratch;
+  if( !scratch )
+    scratch = &local_scratch;
+
+  // Collect the new angles as ids without an approach so that duplicates sort next to each other
+  std::vector<GraspId>& children = scratch->children_;
+  children.clear();
+  children.reserve(parents.size() * 2);
+  for (std::size_t i = 0; i < parents.size(); ++i)
+  {
+    const GraspId& parent = parents[i].id_;
+    int resolution = parent.getAngleResolution() * 2;
+    int index = parent.getAngleIndex() * 2;
+    if( resolution > GraspId::MAX_ANGLE_RESOLUTION )
+      continue;
+
+    // The sweep covers [0, PI], i.e. indices [0, resolution]
+    if( index > 0 )
+      children.push_back(GraspId(request_id, parent.getAxis(), parent.getDirection(), index - 1, resolution,
+                                 APPROACH_BASE_FRAME));
+    if( index < resolution )
+      children.push_back(GraspId(request_id, parent.getAxis(), parent.getDirection(), index + 1, resolution,
+                                 APPROACH_BASE_FRAME));
+  }
+  std::sort(children.begin(), children.end());
+  children.erase(std::unique(children.begin(), children.end()), children.end());
+
+  std::size_t first_new = candidates.size();
+  for (std::size_t i = 0; i < children.size(); ++i)
+  {
+    generateAngleGrasps(block_pose, children[i].getAxis(), children[i].getDirection(), children[i].getAngleIndex(),
+                        children[i].getAngleResolution(), geometry, request_id, candidates);
+  }
+
+  return candidates.size() - first_new;
+}
+
+namespace
+{
+
+// Sort candidate indices by descending quality. Rounded so that mirrored angles with the same
+// score up to floating point noise keep their generation order. Ties are broken by index so that
+// std::sort is stable without the temporary buffer of std::stable_sort
+struct HigherQuality
+{
+  HigherQuality(const GraspCandidates& candidates)
+    : candidates_(candidates)
+  {
+  }
+  bool operator()(std::size_t a, std::size_t b) const
+  {
+    double quality_a = round(candidates_[a]);
+    double quality_b = round(candidates_[b]);
+    if( quality_a != quality_b )
+      return quality_a > quality_b;
+    return a < b;
+  }
+  static double round(const GraspCandidate& candidate)
+  {
+    return floor(candidate.grasp_quality_ * 1e6 + 0.5);
+  }
+  const GraspCandidates& candidates_;
+};
+
+} // namespace
+
+// Drop candidates that are equivalent under the block's and the gripper's symmetry
+std::size_t GraspGeneratorCore::removeSymmetricGrasps(const Eigen::Affine3d& block_pose,
+  const GraspGeometry& geometry, std::size_t first_id, GraspCandidates& candidates, GraspCandidates& variants,
+  GraspScratch* scratch) const
+{
+  if( geometry.symmetry_angle_tolerance_ <= 0 || candidates.size() <= first_id )
+    return 0;
+
+  GraspScratch local_scratch;
+  if( !scratch )
+    scratch = &local_scratch;
+
+  const Eigen::Affine3d global_to_block = block_pose.inverse();
+  const Eigen::Affine3d eef_to_grasp_pose = geometry.grasp_pose_to_eef_pose_.inverse();
+
+  // The symmetry groups. The generic grasp frame approaches the block along its x axis
+  GraspScratch::Transforms& block_symmetries = scratch->block_symmetries_;
+  block_symmetries.clear();
+  for (int i = 0; i < std::max(geometry.block_symmetry_order_, 1); ++i)
+    block_symmetries.push_back(Eigen::Affine3d(Eigen::AngleAxisd(2*M_PI*i / std::max(geometry.block_symmetry_order_, 1),
+                                                                 Eigen::Vector3d::UnitZ())));
+  GraspScratch::Transforms& gripper_symmetries = scratch->gripper_symmetries_;
+  gripper_symmetries.clear();
+  for (int i = 0; i < std::max(geometry.gripper_symmetry_order_, 1); ++i)
+    gripper_symmetries.push_back(Eigen::Affine3d(Eigen::AngleAxisd(2*M_PI*i / std::max(geometry.gripper_symmetry_order_, 1),
+                                                                   Eigen::Vector3d::UnitX())));
+
+  // Visit the best candidates first so they are the ones that are kept
+  std::vector<std::size_t>& order = scratch->order_;
+  order.resize(candidates.size() - first_id);
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = first_id + i;
+  std::sort(order.begin(), order.end(), HigherQuality(candidates));
+
+  // Every symmetric image of the kept candidates' grasp poses in the block frame
+  GraspScratch::Transforms& images = scratch->images_;
+  images.clear();
+  std::vector<std::size_t>& image_owners = scratch->image_owners_;
+  image_owners.clear();
+  std::vector<char>& keep = scratch->keep_;
+  keep.assign(candidates.size(), false);
+
+  for (std::size_t i = 0; i < order.size(); ++i)
+  {
+    GraspCandidate& candidate = candidates[order[i]];
+    Eigen::Affine3d grasp_pose = global_to_block * candidate.grasp_pose_ * eef_to_grasp_pose;
+    Eigen::Quaterniond grasp_orientation(grasp_pose.linear());
+
+    std::size_t match = images.size();
+    for (std::size_t j = 0; j < images.size() && match == images.size(); ++j)
+    {
+      if( candidates[image_owners[j]].approach_ != candidate.approach_ )
+        continue;
+      if( (images[j].translation() - grasp_pose.translation()).norm() > geometry.symmetry_position_tolerance_ )
+        continue;
+      if( Eigen::Quaterniond(images[j].linear()).angularDistance(grasp_orientation) > geometry.symmetry_angle_tolerance_ )
+        continue;
+      match = j;
+    }
+
+    if( match < images.size() )
+    {
+      candidate.canonical_id_ = candidates[image_owners[match]].id_;
+      variants.push_back(candidate);
+      continue;
+    }
+
+    keep[order[i]] = true;
+    for (std::size_t b = 0; b < block_symmetries.size(); ++b)
+      for (std::size_t g = 0; g < gripper_symmetries.size(); ++g)
+      {
+        images.push_back(block_symmetries[b] * grasp_pose * gripper_symmetries[g]);
+        image_owners.push_back(order[i]);
+      }
+  }
+
+  // Compact in generation order
+  std::size_t num_kept = first_id;
+  for (std::size_t i = first_id; i < candidates.size(); ++i)
+  {
+    if( !keep[i] )
+      continue;
+    if( num_kept != i )
+      candidates[num_kept] = candidates[i];
+    ++num_kept;
+  }
+  std::size_t num_removed = candidates.size() - num_kept;
+  candidates.resize(num_kept);
+
+  return num_removed;
+}
+
+// How much a candidate's wrist faces back toward the arm base
+double GraspGeneratorCore::getArmBaseAlignment(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+  const GraspCandidate& candidate)
+{
+  Eigen::Vector3d to_wrist = candidate.grasp_pose_.translation() - block_pose.translation();
+  Eigen::Vector3d to_base = geometry.arm_base_position_ - block_pose.translation();
+  to_base.z() = 0;
+
+  double wrist_distance = to_wrist.norm();
+  double base_distance = to_base.norm();
+  if( wrist_distance < 1e-9 || base_distance < 1e-9 )
+    return 0;
+
+  // Only the horizontal part of the wrist offset counts, grasps from the top reach from any side
+  to_wrist.z() = 0;
+  return to_wrist.dot(to_base) / (wrist_distance * base_distance);
+}
+
+// Sort candidates so the ones facing the arm base come first
+std::size_t GraspGeneratorCore::orderByArmBase(const Eigen::Affine3d& block_pose, const GraspGeometry& geometry,
+  std::size_t first_id, GraspCandidates& candidates, GraspScratch* scratch) const
+{
+  if( !geometry.face_arm_base_ || candidates.size() <= first_id )
+    return 0;
+
+  GraspScratch local_scratch;
+  if( !scratch )
+    scratch = &local_scratch;
+
+  // Negate the alignment so that sorting ascending puts the best first, ties keep generation order
+  // because the index is part of the key
+  std::vector<std::pair<double, std::size_t> >& order = scratch->alignments_;
+  order.clear();
+  order.reserve(candidates.size() - first_id);
+  for (std::size_t i = first_id; i < candidates.size(); ++i)
+  {
+    double alignment = getArmBaseAlignment(block_pose, geometry, candidates[i]);
+    if( alignment >= geometry.min_arm_base_alignment_ )
+      order.push_back(std::make_pair(-alignment, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  GraspCandidates& sorted = scratch->sorted_;
+  sorted.clear();
+  sorted.reserve(order.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    sorted.push_back(candidates[order[i].second]);
+
+  std::size_t num_removed = candidates.size() - first_id - sorted.size();
+  candidates.resize(first_id);
+  candidates.insert(candidates.end(), sorted.begin(), sorted.end());
+
+  return num_removed;
+}
+
+// Recover the candidates dropped in favor of a kept one
+void GraspGeneratorCore::getSymmetricVariants(const GraspId& canonical, const GraspCandidates& variants,
+  GraspCandidates& result)
+{
+  for (std::size_t i = 0; i < variants.size(); ++i)
+    if( variants[i].canonical_id_ == canonical )
+      result.push_back(variants[i]);
+}
+
+// Pose of the generic grasp frame in the block's frame
+bool GraspGeneratorCore::computeBlockGraspPose(grasp_axis_t axis, grasp_direction_t direction, double theta,
+  double radius, Eigen::Affine3d& grasp_pose)
+{
+  double xb = radius*cos(theta);
+  double yb = 0.0; // stay in the y plane of the block
+  double zb = radius*sin(theta);
+
+  // Gripper direction (UP/DOWN) rotation. UP set by default
+  double theta2 = 0.0;
+  if( direction == DOWN )
+  {
+    theta2 = M_PI;
+  }
+
+  switch(axis)
+  {
+    case X_AXIS:
+      grasp_pose = Eigen::AngleAxisd(theta, Eigen::Vector3d::UnitX())
+        * Eigen::AngleAxisd(-0.5*M_PI, Eigen::Vector3d::UnitZ())
+        * Eigen::AngleAxisd(theta2, Eigen::Vector3d::UnitX()); // Flip 'direction'
+
+      grasp_pose.translation() = Eigen::Vector3d( yb, xb ,zb);
+
+      break;
+    case Y_AXIS:
+      grasp_pose =
+        Eigen::AngleAxisd(M_PI - theta, Eigen::Vector3d::UnitY())
+        *Eigen::AngleAxisd(theta2, Eigen::Vector3d::UnitX()); // Flip 'direction'
+
+      grasp_pose.translation() = Eigen::Vector3d( xb, yb ,zb);
+
+      break;
+    case Z_AXIS:
+      return false;
+  }
+
+  return true;
+}
+
+/* The estimated probability of success for this grasp, or some other measure of how "good" it is.
+ * Here we base bias the score based on how far the wrist is from the surface, preferring a greater
+ * distance to prevent wrist/end effector collision with the table
+ */
+double GraspGeneratorCore::scoreGrasp(double theta)
+{
+  double score = sin(theta);
+  return std::max(score,0.1); // don't allow score to drop below 0.1 b/c all grasps are ok
+}
+
+} // namespace
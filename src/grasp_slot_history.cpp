@@ -0,0 +1,216 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Feasibility statistics per grasp sweep slot and block cell
+
+#include <block_grasp_generator/grasp_slot_history.h>
+
+#include <algorithm>
+#include <math.h>
+
+namespace block_grasp_generator
+{
+
+bool GraspSlotHistory::CellKey::operator<(const CellKey& other) const
+{
+  if( x_ != other.x_ )
+    return x_ < other.x_;
+  if( y_ != other.y_ )
+    return y_ < other.y_;
+  if( z_ != other.z_ )
+    return z_ < other.z_;
+  return yaw_ < other.yaw_;
+}
+
+// Constructor
+GraspSlotHistory::GraspSlotHistory(const GraspSlotSettings& settings) :
+  settings_(settings)
+{
+}
+
+// Destructor
+GraspSlotHistory::~GraspSlotHistory()
+{
+}
+
+void GraspSlotHistory::addResults(const Eigen::Affine3d& block_pose, const GraspArena& arena, std::size_t first_id)
+{
+  CellKey key = getKey(block_pose);
+
+  boost::mutex::scoped_lock slock(mutex_);
+  Cell& cell = cells_[key];
+  const GraspCandidates& candidates = arena.getCandidates();
+  for (std::size_t i = first_id; i < candidates.size(); ++i)
+    addResult(cell, getSlot(candidates[i]), arena.getIkTier(i) >= 0);
+}
+
+void GraspSlotHistory::addResult(const Eigen::Affine3d& block_pose, const GraspCandidate& candidate, bool feasible)
+{
+  CellKey key = getKey(block_pose);
+
+  boost::mutex::scoped_lock slock(mutex_);
+  addResult(cells_[key], getSlot(candidate), feasible);
+}
+
+// Count one candidate. Call with the mutex locked
+void GraspSlotHistory::addResult(Cell& cell, int slot, bool feasible)
+{
+  if( cell.attempts_.empty() )
+  {
+    cell.attempts_.resize(getNumSlots(), 0);
+    cell.feasible_.resize(getNumSlots(), 0);
+  }
+
+  ++cell.attempts_[slot];
+  if( feasible )
+    ++cell.feasible_[slot];
+
+  // Old results count less and less, so a slot that starts working again is not held back for long
+  if( settings_.history_length_ > 0 && cell.attempts_[slot] >= settings_.history_length_ )
+  {
+    cell.attempts_[slot] /= 2;
+    cell.feasible_[slot] /= 2;
+  }
+}
+
+bool GraspSlotHistory::getPrunedSlots(const Eigen::Affine3d& block_pose, std::vector<char>& pruned)
+{
+  CellKey key = getKey(block_pose);
+  pruned.assign(getNumSlots(), 0);
+
+  boost::mutex::scoped_lock slock(mutex_);
+  CellMap::iterator cell_it = cells_.find(key);
+  if( cell_it == cells_.end() )
+    return false;
+  Cell& cell = cell_it->second;
+
+  // Now and then try everything, otherwise a pruned slot would never get the chance to come back
+  ++cell.requests_;
+  if( settings_.explore_interval_ > 0 && cell.requests_ % settings_.explore_interval_ == 0 )
+    return false;
+
+  bool any_pruned = false;
+  for (std::size_t i = 0; i < cell.attempts_.size(); ++i)
+  {
+    if( cell.attempts_[i] >= settings_.min_attempts_ &&
+        cell.feasible_[i] < settings_.min_success_rate_ * cell.attempts_[i] )
+    {
+      pruned[i] = 1;
+      any_pruned = true;
+    }
+  }
+  return any_pruned;
+}
+
+std::size_t GraspSlotHistory::pruneGrasps(const Eigen::Affine3d& block_pose, std::size_t first_id,
+  GraspCandidates& candidates)
+{
+  if( candidates.size() <= first_id )
+    return 0;
+
+  // The buffers are reused by every request, only one prunes at a time
+  boost::mutex::scoped_lock slock(prune_mutex_);
+  if( !getPrunedSlots(block_pose, pruned_slots_) )
+    return 0;
+
+  // Stable in place partition, the pruned candidates end up behind the kept ones
+  pruned_candidates_.clear();
+  std::size_t end = first_id;
+  for (std::size_t i = first_id; i < candidates.size(); ++i)
+  {
+    if( pruned_slots_[getSlot(candidates[i])] )
+      pruned_candidates_.push_back(candidates[i]);
+    else
+      candidates[end++] = candidates[i];
+  }
+
+  if( settings_.drop_pruned_ )
+    candidates.resize(end);
+  else
+    std::copy(pruned_candidates_.begin(), pruned_candidates_.end(), candidates.begin() + end);
+
+  return pruned_candidates_.size();
+}
+
+int GraspSlotHistory::getSlot(grasp_axis_t axis, grasp_direction_t direction, int angle_index,
+  int angle_resolution) const
+{
+  // Angles of any resolution map to the nearest of the slots' angles
+  int angle_bin = angle_resolution > 0 ?
+    int(floor(double(angle_index) * settings_.angle_bins_ / angle_resolution + 0.5)) : 0;
+  angle_bin = std::max(0, std::min(settings_.angle_bins_, angle_bin));
+  return (int(axis) * 2 + int(direction)) * (settings_.angle_bins_ + 1) + angle_bin;
+}
+
+int GraspSlotHistory::getSlot(const GraspCandidate& candidate) const
+{
+  return getSlot(candidate.axis_, candidate.direction_, candidate.angle_index_, candidate.id_.getAngleResolution());
+}
+
+bool GraspSlotHistory::getSuccessRate(const Eigen::Affine3d& block_pose, int slot, double& success_rate) const
+{
+  CellKey key = getKey(block_pose);
+
+  boost::mutex::scoped_lock slock(mutex_);
+  CellMap::const_iterator cell_it = cells_.find(key);
+  if( cell_it == cells_.end() || cell_it->second.attempts_.empty() || cell_it->second.attempts_[slot] == 0 )
+    return false;
+
+  success_rate = double(cell_it->second.feasible_[slot]) / cell_it->second.attempts_[slot];
+  return true;
+}
+
+void GraspSlotHistory::clear()
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  cells_.clear();
+}
+
+GraspSlotHistory::CellKey GraspSlotHistory::getKey(const Eigen::Affine3d& block_pose) const
+{
+  CellKey key;
+  key.x_ = int(floor(block_pose.translation().x() / settings_.cell_size_));
+  key.y_ = int(floor(block_pose.translation().y() / settings_.cell_size_));
+  key.z_ = int(floor(block_pose.translation().z() / settings_.cell_size_));
+
+  // Rotation about z, in [0, 2 PI)
+  double yaw = atan2(block_pose.linear()(1, 0), block_pose.linear()(0, 0));
+  if( yaw < 0 )
+    yaw += 2 * M_PI;
+  key.yaw_ = std::min(settings_.yaw_bins_ - 1, int(yaw / (2 * M_PI) * settings_.yaw_bins_));
+  return key;
+}
+
+} // namespace
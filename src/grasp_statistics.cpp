@@ -0,0 +1,337 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Latency histograms and counters of the grasp pipeline's stages
+
+#include <block_grasp_generator/grasp_statistics.h>
+
+#include <sstream>
+#include <math.h>
+
+namespace block_grasp_generator
+{
+
+namespace
+{
+
+// Durations below 2^LINEAR_BITS nanoseconds have a bucket each, above that every power of two is split into
+// 2^SUB_BUCKET_BITS buckets
+static const int SUB_BUCKET_BITS = 4;
+static const int LINEAR_BITS = SUB_BUCKET_BITS + 1;
+static const boost::uint64_t NUM_SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+static const boost::uint64_t LINEAR_END = 1 << LINEAR_BITS;
+
+// Longer durations are recorded as the longest one, about 18 minutes
+static const int MAX_BITS = 40;
+static const std::size_t NUM_BUCKETS = LINEAR_END + (MAX_BITS - LINEAR_BITS) * NUM_SUB_BUCKETS;
+
+} // namespace
+
+// Constructor
+LatencyHistogram::LatencyHistogram() :
+  buckets_(NUM_BUCKETS, 0)
+{
+  reset();
+}
+
+std::size_t LatencyHistogram::getBucket(boost::uint64_t nanoseconds)
+{
+  if( nanoseconds < LINEAR_END )
+    return nanoseconds;
+
+  // Keep the highest LINEAR_BITS bits
+  int highest_bit = 63 - __builtin_clzll(nanoseconds);
+  if( highest_bit >= MAX_BITS )
+    return NUM_BUCKETS - 1;
+  int shift = highest_bit - SUB_BUCKET_BITS;
+  return LINEAR_END + (shift - 1) * NUM_SUB_BUCKETS + ((nanoseconds >> shift) - NUM_SUB_BUCKETS);
+}
+
+// Largest duration of a bucket
+boost::uint64_t LatencyHistogram::getBucketEnd(std::size_t bucket)
+{
+  if( bucket < LINEAR_END )
+    return bucket;
+
+  int shift = (bucket - LINEAR_END) / NUM_SUB_BUCKETS + 1;
+  boost::uint64_t sub_bucket = (bucket - LINEAR_END) % NUM_SUB_BUCKETS + NUM_SUB_BUCKETS;
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::recordNanoseconds(boost::uint64_t nanoseconds)
+{
+  ++buckets_[getBucket(nanoseconds)];
+  ++count_;
+  sum_ += nanoseconds * 1e-9;
+  if( nanoseconds < min_ )
+    min_ = nanoseconds;
+  if( nanoseconds > max_ )
+    max_ = nanoseconds;
+}
+
+// Add the durations of another histogram
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+  if( other.count_ == 0 )
+    return;
+
+  for (std::size_t i = 0; i < NUM_BUCKETS; ++i)
+    buckets_[i] += other.buckets_[i];
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+void LatencyHistogram::reset()
+{
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  sum_ = 0;
+  min_ = boost::uint64_t(-1);
+  max_ = 0;
+}
+
+// Duration below which percentile of the recorded durations lie
+double LatencyHistogram::getPercentile(double percentile) const
+{
+  if( count_ == 0 )
+    return 0;
+
+  boost::uint64_t rank = std::max(boost::uint64_t(1), boost::uint64_t(ceil(percentile * count_)));
+  boost::uint64_t seen = 0;
+  for (std::size_t i = 0; i < NUM_BUCKETS; ++i)
+  {
+    seen += buckets_[i];
+    if( seen >= rank )
+      return std::min(getBucketEnd(i), max_) * 1e-9;
+  }
+  return max_ * 1e-9;
+}
+
+double LatencyHistogram::getMean() const
+{
+  return count_ > 0 ? sum_ / count_ : 0;
+}
+
+double LatencyHistogram::getMin() const
+{
+  return count_ > 0 ? min_ * 1e-9 : 0;
+}
+
+double LatencyHistogram::getMax() const
+{
+  return max_ * 1e-9;
+}
+
+// Constructor
+GraspStatistics::GraspStatistics() :
+  stages_(NUM_GRASP_STAGES),
+  counters_(NUM_GRASP_COUNTERS, 0)
+{
+}
+
+void GraspStatistics::recordStage(grasp_stage_t stage, double seconds)
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  stages_[stage].record(seconds);
+}
+
+void GraspStatistics::mergeStage(grasp_stage_t stage, const LatencyHistogram& histogram)
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  stages_[stage].merge(histogram);
+}
+
+void GraspStatistics::addCount(grasp_counter_t counter, boost::uint64_t count)
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  counters_[counter] += count;
+}
+
+// Copy of a stage's histogram
+LatencyHistogram GraspStatistics::getStage(grasp_stage_t stage) const
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  return stages_[stage];
+}
+
+boost::uint64_t GraspStatistics::getCount(grasp_counter_t counter) const
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  return counters_[counter];
+}
+
+// Forget everything recorded so far
+void GraspStatistics::reset()
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  for (std::size_t i = 0; i < stages_.size(); ++i)
+    stages_[i].reset();
+  std::fill(counters_.begin(), counters_.end(), 0);
+}
+
+// Summary of every stage and every counter
+void GraspStatistics::getDiagnostics(diagnostic_msgs::DiagnosticStatus& status) const
+{
+  // Copy under the lock, format without it
+  std::vector<LatencyHistogram> stages;
+  std::vector<boost::uint64_t> counters;
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    stages = stages_;
+    counters = counters_;
+  }
+
+  static const double PERCENTILES[] = { 0.5, 0.9, 0.99 };
+  static const char* PERCENTILE_NAMES[] = { "p50", "p90", "p99" };
+
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.values.clear();
+  diagnostic_msgs::KeyValue value;
+  for (std::size_t i = 0; i < stages.size(); ++i)
+  {
+    const LatencyHistogram& histogram = stages[i];
+    const std::string name = getStageName(grasp_stage_t(i));
+
+    std::stringstream count;
+    count << histogram.getCount();
+    value.key = name + " count";
+    value.value = count.str();
+    status.values.push_back(value);
+    if( histogram.getCount() == 0 )
+      continue;
+
+    std::stringstream mean;
+    mean << histogram.getMean() * 1e3;
+    value.key = name + " mean ms";
+    value.value = mean.str();
+    status.values.push_back(value);
+
+    for (std::size_t j = 0; j < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); ++j)
+    {
+      std::stringstream percentile;
+      percentile << histogram.getPercentile(PERCENTILES[j]) * 1e3;
+      value.key = name + " " + PERCENTILE_NAMES[j] + " ms";
+      value.value = percentile.str();
+      status.values.push_back(value);
+    }
+
+    std::stringstream max;
+    max << histogram.getMax() * 1e3;
+    value.key = name + " max ms";
+    value.value = max.str();
+    status.values.push_back(value);
+  }
+
+  for (std::size_t i = 0; i < counters.size(); ++i)
+  {
+    std::stringstream count;
+    count << counters[i];
+    value.key = getCounterName(grasp_counter_t(i));
+    value.value = count.str();
+    status.values.push_back(value);
+  }
+
+  std::stringstream message;
+  message << stages[STAGE_IK_REQUEST].getCount() << " filter requests, "
+          << counters[COUNT_IK_SUCCESS] << " IK solutions";
+  status.message = message.str();
+}
+
+const char* GraspStatistics::getStageName(grasp_stage_t stage)
+{
+  switch( stage )
+  {
+    case STAGE_GENERATE:
+      return "generate";
+    case STAGE_PREFILTER:
+      return "prefilter";
+    case STAGE_CONVERT:
+      return "convert";
+    case STAGE_IK_CALL:
+      return "ik call";
+    case STAGE_IK_REQUEST:
+      return "ik request";
+    case STAGE_ASSEMBLE:
+      return "assemble";
+    case STAGE_VISUALIZE:
+      return "visualize";
+    default:
+      return "unknown";
+  }
+}
+
+const char* GraspStatistics::getCounterName(grasp_counter_t counter)
+{
+  switch( counter )
+  {
+    case COUNT_IK_SUCCESS:
+      return "ik success";
+    case COUNT_NO_IK_SOLUTION:
+      return "ik no solution";
+    case COUNT_TIMED_OUT:
+      return "ik timed out";
+    case COUNT_IK_ERROR:
+      return "ik other error";
+    case COUNT_SEED_CACHE_HIT:
+      return "seed cache hit";
+    case COUNT_SEED_CACHE_MISS:
+      return "seed cache miss";
+    default:
+      return "unknown";
+  }
+}
+
+// Constructor, starts publishing
+GraspStatisticsPublisher::GraspStatisticsPublisher(GraspStatisticsPtr statistics, const std::string& name,
+  double period) :
+  statistics_(statistics),
+  name_(name)
+{
+  diagnostics_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+  diagnostics_.status.resize(1);
+  diagnostics_.status[0].name = name_;
+  publish_timer_ = nh_.createWallTimer(ros::WallDuration(period), &GraspStatisticsPublisher::publishCallback, this);
+}
+
+void GraspStatisticsPublisher::publishCallback(const ros::WallTimerEvent& event)
+{
+  diagnostics_.header.stamp = ros::Time::now();
+  statistics_->getDiagnostics(diagnostics_.status[0]);
+  diagnostics_pub_.publish(diagnostics_);
+}
+
+} // namespace
@@ -0,0 +1,252 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Span tracing of the grasp pipeline in the Chrome trace event format
+
+#include <block_grasp_generator/grasp_trace.h>
+
+// C++
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <unistd.h>
+
+namespace block_grasp_generator
+{
+
+// Only its own thread records into a buffer, the lock is taken by others only to enable, clear or write
+struct GraspTracer::ThreadBuffer
+{
+  ThreadBuffer(unsigned int thread, std::size_t capacity)
+    : thread_(thread),
+      events_(capacity),
+      next_event_(0),
+      num_events_(0)
+  {
+  }
+
+  boost::mutex mutex_;
+  unsigned int thread_; // small sequential id of the track
+  std::string name_;
+  std::vector<TraceEvent> events_; // ring buffer
+  std::size_t next_event_; // where the next span goes
+  std::size_t num_events_; // spans in the buffer
+};
+
+boost::atomic<bool> GraspTracer::enabled_(false);
+boost::mutex GraspTracer::mutex_;
+std::vector<GraspTracer::ThreadBufferPtr> GraspTracer::buffers_;
+std::size_t GraspTracer::capacity_ = 0;
+unsigned int GraspTracer::num_threads_ = 0;
+boost::thread_specific_ptr<GraspTracer::ThreadBufferPtr> GraspTracer::thread_buffer_;
+
+namespace
+{
+
+bool compareStart(const TraceEvent& a, const TraceEvent& b)
+{
+  return a.start_ < b.start_;
+}
+
+// Thread names are the only strings that are not literals
+void writeJsonString(std::ostream& out, const std::string& value)
+{
+  out << '"';
+  for (std::size_t i = 0; i < value.size(); ++i)
+  {
+    if( value[i] == '"' || value[i] == '\\' )
+      out << '\\' << value[i];
+    else if( (unsigned char)value[i] >= 0x20 )
+      out << value[i];
+  }
+  out << '"';
+}
+
+} // namespace
+
+// Start recording, keeping the last capacity spans of every thread
+void GraspTracer::enable(std::size_t capacity)
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  capacity_ = std::max(std::size_t(1), capacity);
+
+  // The buffers of threads that have exited are no longer needed
+  std::vector<ThreadBufferPtr> buffers;
+  for (std::size_t i = 0; i < buffers_.size(); ++i)
+  {
+    if( buffers_[i].unique() )
+      continue;
+    boost::mutex::scoped_lock buffer_lock(buffers_[i]->mutex_);
+    buffers_[i]->events_.resize(capacity_);
+    buffers_[i]->next_event_ = 0;
+    buffers_[i]->num_events_ = 0;
+    buffers.push_back(buffers_[i]);
+  }
+  buffers_.swap(buffers);
+
+  enabled_ = true;
+}
+
+// Stop recording, keeps what was recorded
+void GraspTracer::disable()
+{
+  enabled_ = false;
+}
+
+// Forget the recorded spans
+void GraspTracer::clear()
+{
+  boost::mutex::scoped_lock slock(mutex_);
+  for (std::size_t i = 0; i < buffers_.size(); ++i)
+  {
+    boost::mutex::scoped_lock buffer_lock(buffers_[i]->mutex_);
+    buffers_[i]->next_event_ = 0;
+    buffers_[i]->num_events_ = 0;
+  }
+}
+
+// The calling thread's buffer
+GraspTracer::ThreadBuffer& GraspTracer::getThreadBuffer()
+{
+  if( !thread_buffer_.get() )
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    ThreadBufferPtr buffer(new ThreadBuffer(++num_threads_, capacity_));
+    buffers_.push_back(buffer);
+    thread_buffer_.reset(new ThreadBufferPtr(buffer));
+  }
+  return **thread_buffer_;
+}
+
+// Name the calling thread's track
+void GraspTracer::setThreadName(const std::string& name)
+{
+  ThreadBuffer& buffer = getThreadBuffer();
+  boost::mutex::scoped_lock slock(buffer.mutex_);
+  buffer.name_ = name;
+}
+
+// Add a finished span
+void GraspTracer::record(const char* name, const char* category, const char* arg_name, long arg_value,
+  double start, double duration)
+{
+  ThreadBuffer& buffer = getThreadBuffer();
+  boost::mutex::scoped_lock slock(buffer.mutex_);
+  if( buffer.events_.empty() )
+    return;
+
+  // Overwrite the oldest when full
+  TraceEvent& event = buffer.events_[buffer.next_event_];
+  event.name_ = name;
+  event.category_ = category;
+  event.arg_name_ = arg_name;
+  event.arg_value_ = arg_value;
+  event.thread_ = buffer.thread_;
+  event.start_ = start;
+  event.duration_ = duration;
+
+  buffer.next_event_ = (buffer.next_event_ + 1) % buffer.events_.size();
+  if( buffer.num_events_ < buffer.events_.size() )
+    ++buffer.num_events_;
+}
+
+// Write the recorded spans as a Chrome trace event JSON object
+void GraspTracer::writeChromeTrace(std::ostream& out)
+{
+  // Copy under the locks so the workers are not held up by the formatting
+  std::vector<TraceEvent> events;
+  std::map<unsigned int, std::string> thread_names;
+  {
+    boost::mutex::scoped_lock slock(mutex_);
+    for (std::size_t i = 0; i < buffers_.size(); ++i)
+    {
+      const ThreadBuffer& buffer = *buffers_[i];
+      boost::mutex::scoped_lock buffer_lock(buffers_[i]->mutex_);
+      std::size_t size = buffer.events_.size();
+      std::size_t first = size > 0 ? (buffer.next_event_ + size - buffer.num_events_) % size : 0;
+      for (std::size_t j = 0; j < buffer.num_events_; ++j)
+        events.push_back(buffer.events_[(first + j) % size]);
+      if( !buffer.name_.empty() )
+        thread_names[buffer.thread_] = buffer.name_;
+    }
+  }
+
+  // Merge the threads
+  std::stable_sort(events.begin(), events.end(), compareStart);
+
+  const int pid = getpid();
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  bool first_event = true;
+  for (std::map<unsigned int, std::string>::const_iterator it = thread_names.begin(); it != thread_names.end(); ++it)
+  {
+    out << (first_event ? "\n" : ",\n");
+    first_event = false;
+    out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << it->first
+        << ",\"args\":{\"name\":";
+    writeJsonString(out, it->second);
+    out << "}}";
+  }
+
+  for (std::size_t i = 0; i < events.size(); ++i)
+  {
+    const TraceEvent& event = events[i];
+    out << (first_event ? "\n" : ",\n");
+    first_event = false;
+    out << "{\"ph\":\"X\",\"name\":\"" << event.name_ << "\",\"cat\":\"" << event.category_
+        << "\",\"pid\":" << pid << ",\"tid\":" << event.thread_
+        << ",\"ts\":" << event.start_ << ",\"dur\":" << event.duration_;
+    if( event.arg_name_ )
+      out << ",\"args\":{\"" << event.arg_name_ << "\":" << event.arg_value_ << "}";
+    out << "}";
+  }
+
+  out << "\n]}\n";
+}
+
+bool GraspTracer::writeChromeTrace(const std::string& file_name)
+{
+  std::ofstream file(file_name.c_str());
+  if( !file )
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_trace","Unable to write trace " << file_name);
+    return false;
+  }
+  writeChromeTrace(file);
+  return file.good();
+}
+
+} // namespace
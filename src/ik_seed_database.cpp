@@ -0,0 +1,344 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <block_grasp_generator/ik_seed_database.h>
+
+#include <boost/thread/locks.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+namespace block_grasp_generator
+{
+
+const int IkSeedDatabase::KEY_SIZE;
+
+// Orders node indices by one dimension of their key, for splitting a tree at the median
+struct IkSeedDatabase::KeyLess
+{
+  KeyLess(const Tree& tree, int axis)
+    : tree_(tree), axis_(axis)
+  {}
+  bool operator()(int a, int b) const
+  {
+    return tree_.nodes_[a].key_[axis_] < tree_.nodes_[b].key_[axis_];
+  }
+  const Tree& tree_;
+  int axis_;
+};
+
+// Constructor
+IkSeedDatabase::IkSeedDatabase(double rotation_weight, double duplicate_tolerance, std::size_t max_entries) :
+  rotation_weight_(rotation_weight),
+  duplicate_tolerance_(duplicate_tolerance),
+  max_entries_(max_entries)
+{
+}
+
+// Destructor
+IkSeedDatabase::~IkSeedDatabase()
+{
+}
+
+bool IkSeedDatabase::findSeed(const std::string& planning_group, const Eigen::Affine3d& pose,
+                              std::vector<double>& seed, double* distance) const
+{
+  double key[KEY_SIZE];
+  getKey(pose, key);
+
+  boost::shared_lock<boost::shared_mutex> slock(mutex_);
+
+  TreeMap::const_iterator tree_it = trees_.find(planning_group);
+  if( tree_it == trees_.end() )
+    return false;
+  const Tree& tree = tree_it->second;
+
+  double best_distance_sq;
+  int best = findNearest(tree, key, best_distance_sq);
+  if( best < 0 )
+    return false;
+
+  const double* solution = &tree.solutions_[tree.nodes_[best].solution_];
+  seed.assign(solution, solution + tree.num_joints_);
+  if( distance )
+    *distance = sqrt(best_distance_sq);
+  return true;
+}
+
+bool IkSeedDatabase::addSolution(const std::string& planning_group, const Eigen::Affine3d& pose,
+                                 const double* solution, std::size_t num_joints)
+{
+  double key[KEY_SIZE];
+  getKey(pose, key);
+
+  boost::unique_lock<boost::shared_mutex> slock(mutex_);
+
+  Tree& tree = trees_[planning_group];
+  if( tree.nodes_.empty() )
+    tree.num_joints_ = num_joints;
+  else if( tree.num_joints_ != num_joints )
+    return false;
+
+  // Replace the solution of a pose we already know instead of growing the tree
+  double best_distance_sq;
+  int best = findNearest(tree, key, best_distance_sq);
+  if( best >= 0 && best_distance_sq <= duplicate_tolerance_ * duplicate_tolerance_ )
+  {
+    std::copy(solution, solution + num_joints, &tree.solutions_[tree.nodes_[best].solution_]);
+    return true;
+  }
+
+  if( tree.nodes_.size() >= max_entries_ )
+    return true;
+
+  Node node;
+  std::copy(key, key + KEY_SIZE, node.key_);
+  node.solution_ = tree.solutions_.size();
+  node.left_ = -1;
+  node.right_ = -1;
+  tree.nodes_.push_back(node);
+  tree.solutions_.insert(tree.solutions_.end(), solution, solution + num_joints);
+
+  if( tree.nodes_.size() >= 2 * tree.balanced_size_ && tree.nodes_.size() >= 32 )
+    rebuild(tree);
+  else
+    insertNode(tree, tree.nodes_.size() - 1);
+
+  return true;
+}
+
+std::size_t IkSeedDatabase::size(const std::string& planning_group) const
+{
+  boost::shared_lock<boost::shared_mutex> slock(mutex_);
+
+  TreeMap::const_iterator tree_it = trees_.find(planning_group);
+  if( tree_it == trees_.end() )
+    return 0;
+  return tree_it->second.nodes_.size();
+}
+
+void IkSeedDatabase::clear()
+{
+  boost::unique_lock<boost::shared_mutex> slock(mutex_);
+  trees_.clear();
+}
+
+bool IkSeedDatabase::save(const std::string& file_name) const
+{
+  std::ofstream file(file_name.c_str());
+  if( !file )
+    return false;
+  file.precision(std::numeric_limits<double>::digits10 + 2);
+
+  boost::shared_lock<boost::shared_mutex> slock(mutex_);
+
+  // Keys are stored as plain poses so that the file does not depend on the rotation weight
+  file << "ik_seed_database 1\n";
+  for (TreeMap::const_iterator tree_it = trees_.begin(); tree_it != trees_.end(); ++tree_it)
+  {
+    const Tree& tree = tree_it->second;
+    file << "group " << tree_it->first << " " << tree.num_joints_ << " " << tree.nodes_.size() << "\n";
+    for (std::size_t i = 0; i < tree.nodes_.size(); ++i)
+    {
+      const Node& node = tree.nodes_[i];
+      for (int j = 0; j < KEY_SIZE; ++j)
+        file << (j < 3 ? node.key_[j] : node.key_[j] / rotation_weight_) << " ";
+      for (std::size_t j = 0; j < tree.num_joints_; ++j)
+        file << tree.solutions_[node.solution_ + j] << (j + 1 < tree.num_joints_ ? " " : "\n");
+    }
+  }
+
+  return file.good();
+}
+
+bool IkSeedDatabase::load(const std::string& file_name)
+{
+  std::ifstream file(file_name.c_str());
+  if( !file )
+    return false;
+
+  std::string header;
+  int version;
+  if( !(file >> header >> version) || header != "ik_seed_database" || version != 1 )
+    return false;
+
+  // Read everything before touching the known groups so a malformed file changes nothing
+  TreeMap loaded;
+  std::string label;
+  while( file >> label )
+  {
+    std::string planning_group;
+    std::size_t num_joints;
+    std::size_t num_nodes;
+    if( label != "group" || !(file >> planning_group >> num_joints >> num_nodes) )
+      return false;
+
+    Tree& tree = loaded[planning_group];
+    tree.num_joints_ = num_joints;
+    tree.nodes_.resize(num_nodes);
+    tree.solutions_.resize(num_nodes * num_joints);
+    for (std::size_t i = 0; i < num_nodes; ++i)
+    {
+      Node& node = tree.nodes_[i];
+      for (int j = 0; j < KEY_SIZE; ++j)
+      {
+        if( !(file >> node.key_[j]) )
+          return false;
+        if( j >= 3 )
+          node.key_[j] *= rotation_weight_;
+      }
+      node.solution_ = i * num_joints;
+      for (std::size_t j = 0; j < num_joints; ++j)
+        if( !(file >> tree.solutions_[node.solution_ + j]) )
+          return false;
+    }
+    rebuild(tree);
+  }
+
+  boost::unique_lock<boost::shared_mutex> slock(mutex_);
+  for (TreeMap::iterator tree_it = loaded.begin(); tree_it != loaded.end(); ++tree_it)
+    trees_[tree_it->first] = tree_it->second;
+
+  return true;
+}
+
+void IkSeedDatabase::getKey(const Eigen::Affine3d& pose, double* key) const
+{
+  Eigen::Quaterniond rotation(pose.rotation());
+
+  // q and -q are the same orientation, only use the half with w >= 0
+  if( rotation.w() < 0 )
+    rotation.coeffs() *= -1.0;
+
+  key[0] = pose.translation().x();
+  key[1] = pose.translation().y();
+  key[2] = pose.translation().z();
+  key[3] = rotation.x() * rotation_weight_;
+  key[4] = rotation.y() * rotation_weight_;
+  key[5] = rotation.z() * rotation_weight_;
+  key[6] = rotation.w() * rotation_weight_;
+}
+
+double IkSeedDatabase::getDistanceSq(const double* a, const double* b)
+{
+  double distance_sq = 0;
+  for (int i = 0; i < KEY_SIZE; ++i)
+    distance_sq += (a[i] - b[i]) * (a[i] - b[i]);
+  return distance_sq;
+}
+
+int IkSeedDatabase::findNearest(const Tree& tree, const double* key, double& best_distance_sq)
+{
+  int best = -1;
+  best_distance_sq = std::numeric_limits<double>::max();
+  findNearest(tree, tree.root_, 0, key, best, best_distance_sq);
+  return best;
+}
+
+void IkSeedDatabase::findNearest(const Tree& tree, int node, int depth, const double* key,
+                                 int& best, double& best_distance_sq)
+{
+  if( node < 0 )
+    return;
+
+  const Node& current = tree.nodes_[node];
+  double distance_sq = getDistanceSq(key, current.key_);
+  if( distance_sq < best_distance_sq )
+  {
+    best = node;
+    best_distance_sq = distance_sq;
+  }
+
+  // Search the side of the splitting plane the key is on first, the other side only if it can be closer
+  int axis = depth % KEY_SIZE;
+  double offset = key[axis] - current.key_[axis];
+  int near_side = offset < 0 ? current.left_ : current.right_;
+  int far_side = offset < 0 ? current.right_ : current.left_;
+
+  findNearest(tree, near_side, depth + 1, key, best, best_distance_sq);
+  if( offset * offset < best_distance_sq )
+    findNearest(tree, far_side, depth + 1, key, best, best_distance_sq);
+}
+
+void IkSeedDatabase::insertNode(Tree& tree, int node)
+{
+  if( tree.root_ < 0 )
+  {
+    tree.root_ = node;
+    return;
+  }
+
+  const double* key = tree.nodes_[node].key_;
+  int parent = tree.root_;
+  for (int depth = 0; true; ++depth)
+  {
+    int axis = depth % KEY_SIZE;
+    int& child = key[axis] < tree.nodes_[parent].key_[axis] ? tree.nodes_[parent].left_ : tree.nodes_[parent].right_;
+    if( child < 0 )
+    {
+      child = node;
+      return;
+    }
+    parent = child;
+  }
+}
+
+int IkSeedDatabase::buildBalanced(Tree& tree, std::vector<int>& order, std::size_t begin, std::size_t end,
+                                  int depth)
+{
+  if( begin >= end )
+    return -1;
+
+  // Split at the median of this depth's dimension
+  std::size_t middle = begin + (end - begin) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                   KeyLess(tree, depth % KEY_SIZE));
+
+  int node = order[middle];
+  tree.nodes_[node].left_ = buildBalanced(tree, order, begin, middle, depth + 1);
+  tree.nodes_[node].right_ = buildBalanced(tree, order, middle + 1, end, depth + 1);
+  return node;
+}
+
+void IkSeedDatabase::rebuild(Tree& tree)
+{
+  std::vector<int> order(tree.nodes_.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+
+  tree.root_ = buildBalanced(tree, order, 0, order.size(), 0);
+  tree.balanced_size_ = tree.nodes_.size();
+}
+
+} // namespace
@@ -0,0 +1,296 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Learns how long IK takes per workspace region and end effector orientation
+
+#include <block_grasp_generator/ik_timeout_model.h>
+
+#include <boost/thread/locks.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <math.h>
+
+namespace block_grasp_generator
+{
+
+bool IkTimeoutModel::BinKey::operator<(const BinKey& other) const
+{
+  if( x_ != other.x_ )
+    return x_ < other.x_;
+  if( y_ != other.y_ )
+    return y_ < other.y_;
+  if( z_ != other.z_ )
+    return z_ < other.z_;
+  return orientation_ < other.orientation_;
+}
+
+// Constructor
+IkTimeoutModel::IkTimeoutModel(const IkTimeoutSettings& settings) :
+  settings_(settings)
+{
+  quantile_scratch_.reserve(settings_.max_samples_);
+}
+
+// Destructor
+IkTimeoutModel::~IkTimeoutModel()
+{
+}
+
+double IkTimeoutModel::getTimeout(const std::string& planning_group, const Eigen::Affine3d& pose,
+                                  double default_timeout) const
+{
+  BinKey key = getKey(pose);
+
+  boost::shared_lock<boost::shared_mutex> slock(mutex_);
+
+  GroupMap::const_iterator group_it = groups_.find(planning_group);
+  if( group_it == groups_.end() )
+    return default_timeout;
+  BinMap::const_iterator bin_it = group_it->second.find(key);
+  if( bin_it == group_it->second.end() )
+    return default_timeout;
+  const Bin& bin = bin_it->second;
+
+  // Solves slower than the timeout are never seen, so now and then give a query all the time there is
+  if( settings_.explore_interval_ > 0 && bin.queries_ % settings_.explore_interval_ == settings_.explore_interval_ - 1 )
+    return std::max(settings_.max_timeout_, default_timeout);
+
+  // Poses here almost never solve, do not wait for them
+  if( bin.queries_ >= settings_.min_samples_ && bin.solved_ < settings_.min_success_rate_ * bin.queries_ )
+    return settings_.min_timeout_;
+
+  if( bin.solve_times_.size() < settings_.min_samples_ || bin.solve_times_.empty() )
+    return default_timeout;
+  return clampTimeout(bin.solve_time_quantile_ * settings_.margin_);
+}
+
+void IkTimeoutModel::addQuery(const std::string& planning_group, const Eigen::Affine3d& pose, double solve_time,
+                              bool solved)
+{
+  BinKey key = getKey(pose);
+
+  boost::unique_lock<boost::shared_mutex> slock(mutex_);
+
+  Bin& bin = groups_[planning_group][key];
+  ++bin.queries_;
+  if( solved )
+  {
+    ++bin.solved_;
+    if( bin.solve_times_.size() < settings_.max_samples_ )
+      bin.solve_times_.push_back(solve_time);
+    else if( !bin.solve_times_.empty() )
+    {
+      bin.solve_times_[bin.next_sample_] = solve_time;
+      bin.next_sample_ = (bin.next_sample_ + 1) % bin.solve_times_.size();
+    }
+    updateQuantile(bin);
+  }
+
+  // Old queries count less and less
+  if( settings_.history_length_ > 0 && bin.queries_ >= settings_.history_length_ )
+  {
+    bin.queries_ /= 2;
+    bin.solved_ /= 2;
+  }
+}
+
+std::size_t IkTimeoutModel::size(const std::string& planning_group) const
+{
+  boost::shared_lock<boost::shared_mutex> slock(mutex_);
+
+  GroupMap::const_iterator group_it = groups_.find(planning_group);
+  if( group_it == groups_.end() )
+    return 0;
+  return group_it->second.size();
+}
+
+void IkTimeoutModel::clear()
+{
+  boost::unique_lock<boost::shared_mutex> slock(mutex_);
+  groups_.clear();
+}
+
+bool IkTimeoutModel::save(const std::string& file_name) const
+{
+  std::ofstream file(file_name.c_str());
+  if( !file )
+    return false;
+  file.precision(std::numeric_limits<double>::digits10 + 2);
+
+  boost::shared_lock<boost::shared_mutex> slock(mutex_);
+
+  // Bins are only meaningful with the cell size they were made with
+  file << "ik_timeout_model 1 " << settings_.cell_size_ << "\n";
+  for (GroupMap::const_iterator group_it = groups_.begin(); group_it != groups_.end(); ++group_it)
+  {
+    file << "group " << group_it->first << " " << group_it->second.size() << "\n";
+    for (BinMap::const_iterator bin_it = group_it->second.begin(); bin_it != group_it->second.end(); ++bin_it)
+    {
+      const BinKey& key = bin_it->first;
+      const Bin& bin = bin_it->second;
+      file << key.x_ << " " << key.y_ << " " << key.z_ << " " << key.orientation_ << " " << bin.queries_ << " "
+           << bin.solved_ << " " << bin.solve_times_.size();
+
+      // Oldest first, so that loading restores the order of the ring
+      for (std::size_t i = 0; i < bin.solve_times_.size(); ++i)
+        file << " " << bin.solve_times_[(bin.next_sample_ + i) % bin.solve_times_.size()];
+      file << "\n";
+    }
+  }
+
+  return file.good();
+}
+
+bool IkTimeoutModel::load(const std::string& file_name)
+{
+  std::ifstream file(file_name.c_str());
+  if( !file )
+    return false;
+
+  std::string header;
+  int version;
+  double cell_size;
+  if( !(file >> header >> version >> cell_size) || header != "ik_timeout_model" || version != 1 )
+    return false;
+  if( fabs(cell_size - settings_.cell_size_) > 1e-9 )
+    return false;
+
+  // Read everything before touching the known groups so a malformed file changes nothing
+  GroupMap loaded;
+  std::string label;
+  while( file >> label )
+  {
+    std::string planning_group;
+    std::size_t num_bins;
+    if( label != "group" || !(file >> planning_group >> num_bins) )
+      return false;
+
+    BinMap& bins = loaded[planning_group];
+    for (std::size_t i = 0; i < num_bins; ++i)
+    {
+      BinKey key;
+      Bin bin;
+      std::size_t num_samples;
+      if( !(file >> key.x_ >> key.y_ >> key.z_ >> key.orientation_ >> bin.queries_ >> bin.solved_ >> num_samples) )
+        return false;
+
+      // Keep the newest if the file kept more than we do
+      for (std::size_t j = 0; j < num_samples; ++j)
+      {
+        double solve_time;
+        if( !(file >> solve_time) )
+          return false;
+        if( j + settings_.max_samples_ >= num_samples )
+          bin.solve_times_.push_back(solve_time);
+      }
+      bins[key] = bin;
+    }
+  }
+
+  boost::unique_lock<boost::shared_mutex> slock(mutex_);
+  for (GroupMap::iterator group_it = loaded.begin(); group_it != loaded.end(); ++group_it)
+  {
+    for (BinMap::iterator bin_it = group_it->second.begin(); bin_it != group_it->second.end(); ++bin_it)
+      updateQuantile(bin_it->second);
+    groups_[group_it->first] = group_it->second;
+  }
+
+  return true;
+}
+
+IkTimeoutModel::BinKey IkTimeoutModel::getKey(const Eigen::Affine3d& pose) const
+{
+  BinKey key;
+  key.x_ = int(floor(pose.translation().x() / settings_.cell_size_));
+  key.y_ = int(floor(pose.translation().y() / settings_.cell_size_));
+  key.z_ = int(floor(pose.translation().z() / settings_.cell_size_));
+
+  key.orientation_ = getOrientationIndex(pose.rotation());
+  return key;
+}
+
+int IkTimeoutModel::getOrientationIndex(const Eigen::Matrix3d& rotation)
+{
+  // The x and z axes closest to their own base axes can both be closest to the same one, e.g. x = (.71, .70, 0)
+  // and z = (.70, -.71, 0). So try all 24 rotations that map base axes to base axes and keep the nearest, the
+  // one whose axes agree best with the pose's. Its x and z axes are always on different base axes
+  int best_index = 0;
+  double best_agreement = -std::numeric_limits<double>::max();
+  for (int x_index = 0; x_index < 6; ++x_index)
+  {
+    int x_axis = x_index / 2;
+    double x_sign = x_index % 2 ? -1 : 1;
+    for (int z_index = 0; z_index < 6; ++z_index)
+    {
+      int z_axis = z_index / 2;
+      if( z_axis == x_axis )
+        continue;
+      double z_sign = z_index % 2 ? -1 : 1;
+
+      // y = z cross x, along the remaining base axis
+      int y_axis = 3 - x_axis - z_axis;
+      double y_sign = x_sign * z_sign * ((z_axis + 1) % 3 == x_axis ? 1 : -1);
+
+      double agreement = x_sign * rotation(x_axis, 0) + y_sign * rotation(y_axis, 1) + z_sign * rotation(z_axis, 2);
+      if( agreement > best_agreement )
+      {
+        best_agreement = agreement;
+        best_index = x_index * 6 + z_index;
+      }
+    }
+  }
+  return best_index;
+}
+
+void IkTimeoutModel::updateQuantile(Bin& bin)
+{
+  if( bin.solve_times_.empty() )
+    return;
+
+  // The ring has to keep its order, find the quantile in a copy that never allocates
+  quantile_scratch_.assign(bin.solve_times_.begin(), bin.solve_times_.end());
+  std::size_t index = std::min(quantile_scratch_.size() - 1,
+                               std::size_t(settings_.quantile_ * quantile_scratch_.size()));
+  std::nth_element(quantile_scratch_.begin(), quantile_scratch_.begin() + index, quantile_scratch_.end());
+  bin.solve_time_quantile_ = quantile_scratch_[index];
+}
+
+double IkTimeoutModel::clampTimeout(double timeout) const
+{
+  return std::max(settings_.min_timeout_, std::min(settings_.max_timeout_, timeout));
+}
+
+} // namespace
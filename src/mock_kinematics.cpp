@@ -0,0 +1,221 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Stand-in kinematics solver for benchmarking the grasp filter
+
+#include <block_grasp_generator/mock_kinematics.h>
+
+// ROS
+#include <ros/ros.h>
+
+// C++
+#include <boost/random/lognormal_distribution.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/bind.hpp>
+#include <math.h>
+
+namespace block_grasp_generator
+{
+
+namespace
+{
+
+// Gives every solver of an allocator its own latency samples
+boost::mutex allocations_mutex;
+unsigned int num_allocations = 0;
+
+kinematics::KinematicsBasePtr allocateMockKinematics(const MockKinematicsSettings& settings,
+                                                     const robot_model::JointModelGroup* joint_model_group)
+{
+  unsigned int instance;
+  {
+    boost::mutex::scoped_lock slock(allocations_mutex);
+    instance = ++num_allocations;
+  }
+  kinematics::KinematicsBasePtr kin_solver(new MockKinematics(settings, joint_model_group, instance));
+  kin_solver->initialize("robot_description", joint_model_group->getName(), "", "", 0.01);
+  return kin_solver;
+}
+
+// Poses that differ less than this are the same pose
+static const double POSE_RESOLUTION = 1e-6;
+
+void hashValue(std::size_t& seed, double value)
+{
+  boost::hash_combine(seed, long(floor(value / POSE_RESOLUTION + 0.5)));
+}
+
+} // namespace
+
+// Constructor
+MockKinematics::MockKinematics(const MockKinematicsSettings& settings,
+  const robot_model::JointModelGroup* joint_model_group, unsigned int instance) :
+  settings_(settings),
+  joint_names_(joint_model_group->getVariableNames()),
+  link_names_(joint_model_group->getLinkModelNames()),
+  rng_(settings.seed_ + instance)
+{
+}
+
+robot_model::SolverAllocatorFn MockKinematics::getAllocator(const MockKinematicsSettings& settings)
+{
+  return boost::bind(&allocateMockKinematics, settings, _1);
+}
+
+// Whether the mock has a solution for a pose
+bool MockKinematics::isSolvable(const geometry_msgs::Pose& ik_pose) const
+{
+  // The solvable poses must not depend on the solver instance, only on the settings
+  std::size_t hash = settings_.seed_;
+  hashValue(hash, ik_pose.position.x);
+  hashValue(hash, ik_pose.position.y);
+  hashValue(hash, ik_pose.position.z);
+  hashValue(hash, ik_pose.orientation.x);
+  hashValue(hash, ik_pose.orientation.y);
+  hashValue(hash, ik_pose.orientation.z);
+  hashValue(hash, ik_pose.orientation.w);
+
+  boost::random::mt19937 rng(hash);
+  return rng() < settings_.success_rate_ * 4294967296.0;
+}
+
+// Sample a latency and spend it, up to timeout
+bool MockKinematics::spend(double timeout, bool solvable) const
+{
+  double latency = settings_.latency_median_;
+  if( settings_.latency_sigma_ > 0 )
+  {
+    boost::random::lognormal_distribution<double> latency_dist(log(settings_.latency_median_),
+                                                               settings_.latency_sigma_);
+    boost::mutex::scoped_lock slock(rng_mutex_);
+    latency = latency_dist(rng_);
+  }
+
+  bool timed_out = false;
+  if( !solvable && settings_.timeout_behavior_ == MOCK_USE_TIMEOUT )
+    timed_out = true;
+  if( timeout > 0 && latency > timeout )
+    timed_out = true;
+  if( timed_out )
+    latency = timeout;
+
+  if( settings_.busy_wait_ )
+  {
+    ros::WallTime end_time = ros::WallTime::now() + ros::WallDuration(latency);
+    while( ros::WallTime::now() < end_time )
+      ;
+  }
+  else
+    ros::WallDuration(latency).sleep();
+
+  return !timed_out;
+}
+
+bool MockKinematics::getPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+  std::vector<double>& solution, moveit_msgs::MoveItErrorCodes& error_code,
+  const kinematics::KinematicsQueryOptions& options) const
+{
+  return searchPositionIK(ik_pose, ik_seed_state, 0, solution, error_code, options);
+}
+
+bool MockKinematics::searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+  double timeout, std::vector<double>& solution, moveit_msgs::MoveItErrorCodes& error_code,
+  const kinematics::KinematicsQueryOptions& options) const
+{
+  bool solvable = isSolvable(ik_pose);
+  bool in_time = spend(timeout, solvable);
+
+  if( solvable && in_time )
+  {
+    solution.assign(joint_names_.size(), 0.0);
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return true;
+  }
+
+  solution.clear();
+  error_code.val = in_time ? moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION : moveit_msgs::MoveItErrorCodes::TIMED_OUT;
+  return false;
+}
+
+bool MockKinematics::searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+  double timeout, const std::vector<double>& consistency_limits, std::vector<double>& solution,
+  moveit_msgs::MoveItErrorCodes& error_code, const kinematics::KinematicsQueryOptions& options) const
+{
+  return searchPositionIK(ik_pose, ik_seed_state, timeout, solution, error_code, options);
+}
+
+bool MockKinematics::searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+  double timeout, std::vector<double>& solution, const IKCallbackFn& solution_callback,
+  moveit_msgs::MoveItErrorCodes& error_code, const kinematics::KinematicsQueryOptions& options) const
+{
+  if( !searchPositionIK(ik_pose, ik_seed_state, timeout, solution, error_code, options) )
+    return false;
+
+  // Let the callback reject the solution
+  if( solution_callback )
+  {
+    solution_callback(ik_pose, solution, error_code);
+    if( error_code.val != moveit_msgs::MoveItErrorCodes::SUCCESS )
+    {
+      solution.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MockKinematics::searchPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+  double timeout, const std::vector<double>& consistency_limits, std::vector<double>& solution,
+  const IKCallbackFn& solution_callback, moveit_msgs::MoveItErrorCodes& error_code,
+  const kinematics::KinematicsQueryOptions& options) const
+{
+  return searchPositionIK(ik_pose, ik_seed_state, timeout, solution, solution_callback, error_code, options);
+}
+
+bool MockKinematics::getPositionFK(const std::vector<std::string>& link_names,
+  const std::vector<double>& joint_angles, std::vector<geometry_msgs::Pose>& poses) const
+{
+  ROS_ERROR_STREAM_NAMED("mock_kinematics","Forward kinematics is not supported");
+  return false;
+}
+
+bool MockKinematics::initialize(const std::string& robot_description, const std::string& group_name,
+  const std::string& base_frame, const std::string& tip_frame, double search_discretization)
+{
+  setValues(robot_description, group_name, base_frame, tip_frame, search_discretization);
+  return true;
+}
+
+} // namespace
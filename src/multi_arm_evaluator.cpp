@@ -0,0 +1,264 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Author: Dave Coleman
+// Desc:   Evaluates the grasps of a block for several arms at once
+
+#include <block_grasp_generator/multi_arm_evaluator.h>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+namespace block_grasp_generator
+{
+
+// Constructor
+MultiArmGraspEvaluator::MultiArmGraspEvaluator(const MultiArmSettings& settings) :
+  settings_(settings),
+  enough_arm_(-1)
+{
+}
+
+// Destructor
+MultiArmGraspEvaluator::~MultiArmGraspEvaluator()
+{
+}
+
+std::size_t MultiArmGraspEvaluator::addArm(const std::string& name, const RobotGraspData& grasp_data,
+  GraspFilterPtr filter)
+{
+  ArmPtr arm(new Arm());
+  arm->name_ = name;
+  arm->grasp_data_ = grasp_data;
+  arm->filter_ = filter;
+  arm->num_good_grasps_ = 0;
+  arm->best_quality_ = -1;
+  arm->succeeded_ = false;
+  arm->mirrored_arm_ = -1;
+  arm->is_mirrored_ = false;
+  arms_.push_back(arm);
+  return arms_.size() - 1;
+}
+
+// Evaluate two arms together
+bool MultiArmGraspEvaluator::setArmSymmetry(std::size_t arm, std::size_t mirrored_arm, const ArmSymmetry& symmetry)
+{
+  Arm& arm_data = *arms_[arm];
+  Arm& mirrored_data = *arms_[mirrored_arm];
+  if( arm == mirrored_arm || arm_data.mirrored_arm_ >= 0 || arm_data.is_mirrored_ ||
+      mirrored_data.mirrored_arm_ >= 0 || mirrored_data.is_mirrored_ )
+  {
+    ROS_ERROR_STREAM_NAMED("grasp","Unable to pair arm " << mirrored_data.name_ << " with arm " << arm_data.name_);
+    return false;
+  }
+
+  arm_data.mirrored_arm_ = mirrored_arm;
+  arm_data.symmetry_ = symmetry;
+  mirrored_data.is_mirrored_ = true;
+  return true;
+}
+
+// Evaluate all arms at once
+int MultiArmGraspEvaluator::evaluate(const Eigen::Affine3d& block_pose, uint32_t request_id,
+  const ArmGraspCallback& callback)
+{
+  GRASP_TRACE_SPAN_ARG("multi arm request", "arms", arms_.size());
+
+  enough_arm_ = -1;
+  for (std::size_t i = 0; i < arms_.size(); ++i)
+  {
+    arms_[i]->num_good_grasps_ = 0;
+    arms_[i]->best_quality_ = -1;
+    arms_[i]->filter_->cancelRequests(false);
+  }
+
+  // The calling thread takes the first arm, the pools of the filters do the IK. Mirrored arms are evaluated by
+  // the thread of the arm they mirror
+  boost::thread_group threads;
+  int first_arm = -1;
+  for (std::size_t i = 0; i < arms_.size(); ++i)
+  {
+    if( arms_[i]->is_mirrored_ )
+      continue;
+    if( first_arm < 0 )
+      first_arm = i;
+    else
+      threads.create_thread(boost::bind(&MultiArmGraspEvaluator::evaluateArm, this, i, boost::cref(block_pose),
+                                        request_id, boost::cref(callback)));
+  }
+  if( first_arm >= 0 )
+    evaluateArm(first_arm, block_pose, request_id, callback);
+  threads.join_all();
+
+  // Leave the filters usable for single arm requests
+  for (std::size_t i = 0; i < arms_.size(); ++i)
+    arms_[i]->filter_->cancelRequests(false);
+
+  if( enough_arm_ >= 0 )
+  {
+    GRASP_LOG_DEBUG_STREAM("grasp","Arm " << arms_[enough_arm_]->name_ << " found enough grasps first");
+    return enough_arm_;
+  }
+
+  // Otherwise the arm with the most good grasps, then with the best grasp
+  int recommended = -1;
+  for (std::size_t i = 0; i < arms_.size(); ++i)
+  {
+    const Arm& arm = *arms_[i];
+    if( !arm.succeeded_ || arm.arena_.getCandidates().empty() )
+      continue;
+    if( recommended < 0 || arm.num_good_grasps_ > arms_[recommended]->num_good_grasps_ ||
+        ( arm.num_good_grasps_ == arms_[recommended]->num_good_grasps_ &&
+          arm.best_quality_ > arms_[recommended]->best_quality_ ) )
+      recommended = i;
+  }
+  return recommended;
+}
+
+// Body of an arm's thread
+void MultiArmGraspEvaluator::evaluateArm(std::size_t arm, const Eigen::Affine3d& block_pose, uint32_t request_id,
+  const ArmGraspCallback& callback)
+{
+  Arm& arm_data = *arms_[arm];
+  if( GraspTracer::isEnabled() )
+    GraspTracer::setThreadName("arm " + arm_data.name_);
+
+  if( arm_data.mirrored_arm_ >= 0 )
+  {
+    Arm& mirrored_data = *arms_[arm_data.mirrored_arm_];
+    arm_data.succeeded_ = filterMirroredArms(arm, block_pose, request_id, callback);
+    mirrored_data.succeeded_ = arm_data.succeeded_;
+    if( !arm_data.succeeded_ )
+    {
+      ROS_ERROR_STREAM_NAMED("grasp","Unable to evaluate the grasps of arms " << arm_data.name_ << " and "
+                             << mirrored_data.name_);
+      arm_data.arena_.reset();
+      mirrored_data.arena_.reset();
+    }
+    return;
+  }
+
+  GraspGeometry geometry;
+  BlockGraspGenerator::getGraspGeometry(arm_data.grasp_data_, geometry);
+
+  // Streaming cannot order, deduplicate or refine candidates it has not generated yet
+  if( GraspFilter::canStream(geometry) )
+    arm_data.succeeded_ = arm_data.filter_->streamGrasps(block_pose, geometry, request_id,
+      boost::bind(&MultiArmGraspEvaluator::feasibleGraspCB, this, arm, boost::cref(callback), _1, _2),
+      arm_data.arena_);
+  else
+    arm_data.succeeded_ = filterArm(arm, block_pose, geometry, request_id, callback);
+  if( !arm_data.succeeded_ )
+  {
+    ROS_ERROR_STREAM_NAMED("grasp","Unable to evaluate the grasps of arm " << arm_data.name_);
+    arm_data.arena_.reset();
+  }
+}
+
+// Generate, prefilter and filter an arm's grasps in batch
+bool MultiArmGraspEvaluator::filterArm(std::size_t arm, const Eigen::Affine3d& block_pose,
+  const GraspGeometry& geometry, uint32_t request_id, const ArmGraspCallback& callback)
+{
+  Arm& arm_data = *arms_[arm];
+  if( !arm_data.filter_->generateGrasps(block_pose, geometry, request_id, arm_data.arena_) )
+    return false;
+
+  // Coarse to fine when asked for
+  bool filtered = geometry.max_angle_resolution_ > geometry.angle_resolution_ ?
+    arm_data.filter_->filterGraspsAdaptive(block_pose, geometry, request_id, arm_data.arena_) :
+    arm_data.filter_->filterGrasps(block_pose, arm_data.arena_);
+  if( !filtered )
+    return false;
+
+  deliverGrasps(arm, callback);
+  return true;
+}
+
+// Filter a mirror-symmetric pair of arms
+bool MultiArmGraspEvaluator::filterMirroredArms(std::size_t arm, const Eigen::Affine3d& block_pose,
+  uint32_t request_id, const ArmGraspCallback& callback)
+{
+  Arm& arm_data = *arms_[arm];
+  Arm& mirrored_data = *arms_[arm_data.mirrored_arm_];
+
+  GraspGeometry geometry;
+  BlockGraspGenerator::getGraspGeometry(arm_data.grasp_data_, geometry);
+  GraspGeometry mirrored_geometry;
+  BlockGraspGenerator::getGraspGeometry(mirrored_data.grasp_data_, mirrored_geometry);
+
+  if( !arm_data.filter_->generateGrasps(block_pose, geometry, request_id, arm_data.arena_) ||
+      !mirrored_data.filter_->generateGrasps(block_pose, mirrored_geometry, request_id, mirrored_data.arena_) ||
+      !arm_data.filter_->filterMirroredGrasps(arm_data.symmetry_, *mirrored_data.filter_, arm_data.arena_,
+                                              mirrored_data.arena_) )
+    return false;
+
+  deliverGrasps(arm, callback);
+  deliverGrasps(arm_data.mirrored_arm_, callback);
+  return true;
+}
+
+// Pass on the feasible grasps of an arm
+void MultiArmGraspEvaluator::deliverGrasps(std::size_t arm, const ArmGraspCallback& callback)
+{
+  const GraspArena& arena = arms_[arm]->arena_;
+  const GraspCandidates& candidates = arena.getCandidates();
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+    feasibleGraspCB(arm, callback, candidates[i], arena.getSolution(i));
+}
+
+// Count a feasible grasp and pass it on
+void MultiArmGraspEvaluator::feasibleGraspCB(std::size_t arm, const ArmGraspCallback& callback,
+  const GraspCandidate& candidate, const double* solution)
+{
+  boost::mutex::scoped_lock slock(mutex_);
+
+  Arm& arm_data = *arms_[arm];
+  arm_data.best_quality_ = std::max(arm_data.best_quality_, candidate.grasp_quality_);
+  if( candidate.grasp_quality_ >= settings_.min_quality_ )
+    ++arm_data.num_good_grasps_;
+
+  // Enough to pick with, stop every arm. Grasps already found still arrive
+  if( settings_.enough_grasps_ > 0 && enough_arm_ < 0 && arm_data.num_good_grasps_ >= settings_.enough_grasps_ )
+  {
+    enough_arm_ = arm;
+    for (std::size_t i = 0; i < arms_.size(); ++i)
+      arms_[i]->filter_->cancelRequests(true);
+  }
+
+  if( callback )
+    callback(arm, candidate, solution);
+}
+
+} // namespace
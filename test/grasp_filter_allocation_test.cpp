@@ -0,0 +1,245 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman
+   Desc:   Checks that generating and filtering grasps is free of heap allocations once the arena and the solvers
+           are warmed up. Solves a synthetic 7 joint arm with MockKinematics, so no robot's MoveIt config is needed
+*/
+
+// ROS
+#include <ros/ros.h>
+#include <gtest/gtest.h>
+
+// Grasp generation and filtering
+#include <block_grasp_generator/grasp_generator_core.h>
+#include <block_grasp_generator/grasp_filter.h>
+#include <block_grasp_generator/grasp_slot_history.h>
+#include <block_grasp_generator/mock_kinematics.h>
+
+// The synthetic arm and the allocation count
+#include "benchmark_utils.h"
+
+namespace
+{
+
+static const std::string BASE_LINK = "base";
+static const std::string PLANNING_GROUP = "arm";
+static const std::size_t NUM_JOINTS = 7;
+static const std::size_t NUM_WARM_UP_REQUESTS = 100; // enough to fill the timeout model's sample rings
+static const std::size_t NUM_REQUESTS = 10;
+
+using block_grasp_generator::getNumAllocations;
+
+Eigen::Affine3d getBlockPose()
+{
+  return Eigen::Translation3d(0.6, 0.2, -0.1) * Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ());
+}
+
+// With every prefilter and adaptive sampling on
+block_grasp_generator::GraspGeometry getGeometry()
+{
+  block_grasp_generator::GraspGeometry geometry;
+  geometry.max_angle_resolution_ = geometry.angle_resolution_ * 2;
+  geometry.symmetry_angle_tolerance_ = 0.05;
+  geometry.face_arm_base_ = true;
+  geometry.min_arm_base_alignment_ = -0.5;
+  return geometry;
+}
+
+// Everything that runs per query stays on: the seed database, the timeout model and the slot history
+block_grasp_generator::GraspFilterPtr loadGraspFilter(const robot_model::RobotModelConstPtr& robot_model)
+{
+  // Fast and deterministic, about half of the poses are solvable
+  block_grasp_generator::MockKinematicsSettings mock_settings;
+  mock_settings.latency_median_ = 0.00001;
+  mock_settings.latency_sigma_ = 0;
+  mock_settings.timeout_behavior_ = block_grasp_generator::MOCK_FAIL_FAST;
+
+  block_grasp_generator::GraspFilterPtr grasp_filter(
+    new block_grasp_generator::GraspFilter(BASE_LINK, robot_model, PLANNING_GROUP));
+  grasp_filter->setSolverAllocator(block_grasp_generator::MockKinematics::getAllocator(mock_settings));
+  grasp_filter->setTimeoutModel(block_grasp_generator::IkTimeoutModelPtr(new block_grasp_generator::IkTimeoutModel()));
+  grasp_filter->setSlotHistory(block_grasp_generator::GraspSlotHistoryPtr(
+    new block_grasp_generator::GraspSlotHistory()));
+  grasp_filter->setLogSummaryPeriod(1e9); // the summary line is formatted on the heap
+
+  // The same threads for every request
+  block_grasp_generator::ConcurrencySettings concurrency_settings;
+  concurrency_settings.max_threads_ = 2;
+  concurrency_settings.min_work_per_thread_ = 0;
+  concurrency_settings.use_load_average_ = false;
+  grasp_filter->setConcurrencySettings(concurrency_settings);
+
+  return grasp_filter;
+}
+
+} // namespace
+
+TEST(GraspGeneratorAllocation, WarmGenerateGraspsDoesNotAllocate)
+{
+  const Eigen::Affine3d block_pose = getBlockPose();
+  const block_grasp_generator::GraspGeometry geometry = getGeometry();
+  block_grasp_generator::GraspGeneratorCore generator_core;
+  block_grasp_generator::GraspArena arena;
+  block_grasp_generator::GraspCandidates variants;
+  block_grasp_generator::GraspCandidates parents;
+
+  unsigned long start_allocations = 0;
+  for (std::size_t i = 0; i < 1 + NUM_REQUESTS; ++i)
+  {
+    // The first request is the warm up
+    if( i == 1 )
+      start_allocations = getNumAllocations();
+
+    arena.reset();
+    block_grasp_generator::GraspCandidates& candidates = arena.getCandidates();
+    candidates.reserve(block_grasp_generator::GraspGeneratorCore::getNumGrasps(geometry));
+    ASSERT_TRUE(generator_core.generateGrasps(block_pose, geometry, 0, candidates));
+    std::size_t num_generated = candidates.size();
+    EXPECT_GT(generator_core.orderByArmBase(block_pose, geometry, 0, candidates, &arena.getScratch()), 0u);
+    variants.clear();
+    EXPECT_GT(generator_core.removeSymmetricGrasps(block_pose, geometry, 0, candidates, variants,
+                                                   &arena.getScratch()), 0u);
+    ASSERT_LT(candidates.size(), num_generated);
+
+    // Refine around every other survivor
+    parents.clear();
+    for (std::size_t j = 0; j < candidates.size(); j += 2)
+      parents.push_back(candidates[j]);
+    EXPECT_GT(generator_core.refineGrasps(block_pose, geometry, 0, parents, candidates, &arena.getScratch()), 0u);
+  }
+  EXPECT_EQ(0ul, getNumAllocations() - start_allocations);
+}
+
+TEST(GraspFilterAllocation, WarmFilterGraspsDoesNotAllocate)
+{
+  robot_model::RobotModelConstPtr robot_model =
+    block_grasp_generator::loadChainRobotModel(BASE_LINK, PLANNING_GROUP, NUM_JOINTS);
+  ASSERT_TRUE(robot_model);
+  block_grasp_generator::GraspFilterPtr grasp_filter = loadGraspFilter(robot_model);
+
+  const Eigen::Affine3d block_pose = getBlockPose();
+  block_grasp_generator::GraspGeneratorCore generator_core;
+  block_grasp_generator::GraspGeometry geometry;
+  block_grasp_generator::GraspCandidates candidates;
+  generator_core.generateGrasps(block_pose, geometry, 0, candidates);
+  ASSERT_FALSE(candidates.empty());
+
+  block_grasp_generator::GraspArena arena;
+  for (std::size_t i = 0; i < NUM_WARM_UP_REQUESTS; ++i)
+  {
+    arena.reset();
+    arena.getCandidates().assign(candidates.begin(), candidates.end());
+    ASSERT_TRUE(grasp_filter->filterGrasps(block_pose, arena));
+  }
+  ASSERT_FALSE(arena.getCandidates().empty());
+
+  unsigned long start_allocations = getNumAllocations();
+  for (std::size_t i = 0; i < NUM_REQUESTS; ++i)
+  {
+    arena.reset();
+    arena.getCandidates().assign(candidates.begin(), candidates.end());
+    ASSERT_TRUE(grasp_filter->filterGrasps(arena));
+
+    arena.reset();
+    arena.getCandidates().assign(candidates.begin(), candidates.end());
+    ASSERT_TRUE(grasp_filter->filterGrasps(block_pose, arena));
+  }
+  EXPECT_EQ(0ul, getNumAllocations() - start_allocations);
+}
+
+TEST(GraspFilterAllocation, WarmGenerateAndFilterAdaptiveDoesNotAllocate)
+{
+  robot_model::RobotModelConstPtr robot_model =
+    block_grasp_generator::loadChainRobotModel(BASE_LINK, PLANNING_GROUP, NUM_JOINTS);
+  ASSERT_TRUE(robot_model);
+  block_grasp_generator::GraspFilterPtr grasp_filter = loadGraspFilter(robot_model);
+
+  const Eigen::Affine3d block_pose = getBlockPose();
+  const block_grasp_generator::GraspGeometry geometry = getGeometry();
+
+  block_grasp_generator::GraspArena arena;
+  for (std::size_t i = 0; i < NUM_WARM_UP_REQUESTS; ++i)
+  {
+    ASSERT_TRUE(grasp_filter->generateGrasps(block_pose, geometry, 0, arena));
+    ASSERT_TRUE(grasp_filter->filterGraspsAdaptive(block_pose, geometry, 0, arena));
+  }
+  ASSERT_FALSE(arena.getCandidates().empty());
+
+  unsigned long start_allocations = getNumAllocations();
+  for (std::size_t i = 0; i < NUM_REQUESTS; ++i)
+  {
+    ASSERT_TRUE(grasp_filter->generateGrasps(block_pose, geometry, 0, arena));
+    ASSERT_TRUE(grasp_filter->filterGraspsAdaptive(block_pose, geometry, 0, arena));
+  }
+  EXPECT_EQ(0ul, getNumAllocations() - start_allocations);
+}
+
+TEST(GraspSlotHistoryAllocation, WarmPruneGraspsDoesNotAllocate)
+{
+  // Prune right away and never explore, so that every request prunes
+  block_grasp_generator::GraspSlotSettings settings;
+  settings.min_attempts_ = 1;
+  settings.explore_interval_ = 0;
+  settings.drop_pruned_ = false;
+  block_grasp_generator::GraspSlotHistory slot_history(settings);
+
+  const Eigen::Affine3d block_pose = getBlockPose();
+  block_grasp_generator::GraspGeneratorCore generator_core;
+  block_grasp_generator::GraspGeometry geometry;
+  block_grasp_generator::GraspCandidates templates;
+  generator_core.generateGrasps(block_pose, geometry, 0, templates);
+  for (std::size_t i = 0; i < templates.size(); i += 3)
+    slot_history.addResult(block_pose, templates[i], false);
+
+  block_grasp_generator::GraspCandidates candidates;
+  candidates.reserve(templates.size());
+  candidates.assign(templates.begin(), templates.end());
+  ASSERT_GT(slot_history.pruneGrasps(block_pose, 0, candidates), 0);
+
+  unsigned long start_allocations = getNumAllocations();
+  for (std::size_t i = 0; i < NUM_REQUESTS; ++i)
+  {
+    candidates.assign(templates.begin(), templates.end());
+    slot_history.pruneGrasps(block_pose, 0, candidates);
+  }
+  EXPECT_EQ(0ul, getNumAllocations() - start_allocations);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "grasp_filter_allocation_test", ros::init_options::AnonymousName);
+  return RUN_ALL_TESTS();
+}